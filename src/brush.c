@@ -0,0 +1,292 @@
+#include "brush.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rng.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static rng_t brush_rng = { 0x853c49e6748fea9bull };
+
+void brush_seed(uint64_t seed)
+{
+    brush_rng = make_rng(seed);
+}
+
+// :SPANS
+
+static void fill_span_scalar(grid_t* grid, int at, int count, particle_t particle, uint32_t threshold)
+{
+    const bool erase = particle == PARTICLE_AIR;
+    for (int i = at; i < at + count; i++) {
+        if (rng_chance(&brush_rng, threshold) && (erase || grid->data[i] == PARTICLE_AIR)) {
+            set_cell(grid, i, particle);
+        }
+    }
+}
+
+// the `count` cells stored one after the other from index at
+static void fill_cells(grid_t* grid, int at, int count, particle_t particle, uint32_t threshold)
+{
+    grid_touch(grid, at, count);
+    int* cells = grid->data + at;
+    int i = 0;
+
+#if defined(__SSE2__)
+    // 4 lanes of xorshift32, seeded from the scalar generator once per span
+    uint64_t seed_lo = rng_next(&brush_rng) | 0x0000000100000001ull;
+    uint64_t seed_hi = rng_next(&brush_rng) | 0x0000000100000001ull;
+    __m128i state = _mm_set_epi64x((long long)seed_hi, (long long)seed_lo);
+    const __m128i limit = _mm_set1_epi32((int)threshold);
+    const __m128i air = _mm_set1_epi32(PARTICLE_AIR);
+    const __m128i value = _mm_set1_epi32(particle);
+    const __m128i all = _mm_set1_epi32(-1);
+    const bool erase = particle == PARTICLE_AIR;
+    for (; i + 4 <= count; i += 4) {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        __m128i hit = _mm_cmplt_epi32(_mm_srli_epi32(state, 16), limit);
+
+        __m128i cur = _mm_loadu_si128((const __m128i*)(cells + i));
+        __m128i writable = erase ? all : _mm_cmpeq_epi32(cur, air);
+        __m128i mask = _mm_and_si128(hit, writable);
+        cur = _mm_or_si128(_mm_and_si128(mask, value), _mm_andnot_si128(mask, cur));
+        _mm_storeu_si128((__m128i*)(cells + i), cur);
+
+        // the same lanes of the life and moisture planes are cleared, one byte each
+        const __m128i words = _mm_packs_epi32(mask, mask);
+        const __m128i bytes = _mm_packs_epi16(words, words);
+        const uint32_t keep = ~(uint32_t)_mm_cvtsi128_si32(bytes);
+        uint32_t aux;
+        memcpy(&aux, grid->life + at + i, sizeof(aux));
+        aux &= keep;
+        memcpy(grid->life + at + i, &aux, sizeof(aux));
+        memcpy(&aux, grid->moisture + at + i, sizeof(aux));
+        aux &= keep;
+        memcpy(grid->moisture + at + i, &aux, sizeof(aux));
+    }
+#endif
+    fill_span_scalar(grid, at + i, count - i, particle, threshold);
+}
+
+void brush_fill_span(grid_t* grid, int x1, int x2, int y, particle_t particle, float density)
+{
+    if (y < 0 || y >= grid->height)
+        return;
+    if (x1 < 0)
+        x1 = 0;
+    if (x2 > grid->width - 1)
+        x2 = grid->width - 1;
+    const uint32_t threshold = rng_threshold(density);
+    if (threshold == 0)
+        return;
+    for (int x = x1; x <= x2;) {
+        const int span = grid_span(grid, x) < x2 - x + 1 ? grid_span(grid, x) : x2 - x + 1;
+        fill_cells(grid, grid_index(grid, x, y), span, particle, threshold);
+        x += span;
+    }
+}
+
+void brush_set_span(grid_t* grid, int x1, int x2, int y, particle_t particle)
+{
+    if (y < 0 || y >= grid->height)
+        return;
+    if (x1 < 0)
+        x1 = 0;
+    if (x2 > grid->width - 1)
+        x2 = grid->width - 1;
+    for (int x = x1; x <= x2; x++) {
+        set_cell(grid, grid_index(grid, x, y), particle);
+    }
+}
+
+// :SHAPES
+
+void brush_rect(grid_t* grid, int x0, int y0, int x1, int y1, particle_t particle, float density)
+{
+    int left = x0 < x1 ? x0 : x1, right = x0 < x1 ? x1 : x0;
+    int top = y0 < y1 ? y0 : y1, bottom = y0 < y1 ? y1 : y0;
+    if (top < 0)
+        top = 0;
+    if (bottom > grid->height - 1)
+        bottom = grid->height - 1;
+    for (int y = top; y <= bottom; y++) {
+        brush_fill_span(grid, left, right, y, particle, density);
+    }
+}
+
+void brush_circle(grid_t* grid, int xc, int yc, int r, particle_t particle, float density)
+{
+    if (r < 0)
+        return;
+    // r * r + r matches the footprint of the midpoint circle this replaced
+    const int limit = r * r + r;
+    int dx = r;
+    for (int dy = 0; dy <= r; dy++) {
+        while (dx > 0 && dx * dx + dy * dy > limit) {
+            dx--;
+        }
+        brush_fill_span(grid, xc - dx, xc + dx, yc + dy, particle, density);
+        if (dy != 0)
+            brush_fill_span(grid, xc - dx, xc + dx, yc - dy, particle, density);
+    }
+}
+
+static inline int circle_half_width(int dy, int limit)
+{
+    int sq = limit - dy * dy;
+    return sq < 0 ? -1 : (int)sqrtf((float)sq);
+}
+
+void brush_capsule(grid_t* grid, int x0, int y0, int x1, int y1, int r, particle_t particle, float density)
+{
+    if (r < 0)
+        return;
+    if (x0 == x1 && y0 == y1) {
+        brush_circle(grid, x0, y0, r, particle, density);
+        return;
+    }
+
+    // same footprint as brush_circle: a cell is inside if its distance² <= r² + r
+    const int limit = r * r + r;
+    const float radius = sqrtf((float)limit);
+    const float dx = (float)(x1 - x0), dy = (float)(y1 - y0);
+    const float length = sqrtf(dx * dx + dy * dy);
+    const float nx = -dy / length * radius, ny = dx / length * radius;
+    const float quad[4][2] = {
+        { x0 + nx, y0 + ny },
+        { x1 + nx, y1 + ny },
+        { x1 - nx, y1 - ny },
+        { x0 - nx, y0 - ny },
+    };
+
+    int top = (y0 < y1 ? y0 : y1) - r;
+    int bottom = (y0 > y1 ? y0 : y1) + r;
+    if (top < 0)
+        top = 0;
+    if (bottom > grid->height - 1)
+        bottom = grid->height - 1;
+
+    // the capsule is convex, so each row is one span: the union of the two
+    // end caps and the swept band
+    for (int y = top; y <= bottom; y++) {
+        int left = INT32_MAX, right = INT32_MIN;
+
+        int h0 = circle_half_width(y - y0, limit);
+        if (h0 >= 0) {
+            left = x0 - h0;
+            right = x0 + h0;
+        }
+        int h1 = circle_half_width(y - y1, limit);
+        if (h1 >= 0) {
+            left = x1 - h1 < left ? x1 - h1 : left;
+            right = x1 + h1 > right ? x1 + h1 : right;
+        }
+
+        float band_left = INFINITY, band_right = -INFINITY;
+        for (int i = 0; i < 4; i++) {
+            const float* p = quad[i];
+            const float* q = quad[(i + 1) % 4];
+            if ((p[1] - y) * (q[1] - y) > 0.0f || p[1] == q[1])
+                continue;
+            float x = p[0] + (y - p[1]) * (q[0] - p[0]) / (q[1] - p[1]);
+            band_left = fminf(band_left, x);
+            band_right = fmaxf(band_right, x);
+        }
+        if (band_left <= band_right) {
+            int bl = (int)ceilf(band_left), br = (int)floorf(band_right);
+            if (bl <= br) {
+                left = bl < left ? bl : left;
+                right = br > right ? br : right;
+            }
+        }
+
+        if (left <= right)
+            brush_fill_span(grid, left, right, y, particle, density);
+    }
+}
+
+// :FLOOD FILL
+
+typedef struct {
+    int x, y;
+} seed_t;
+
+// kept between calls so steady state fills do not allocate
+static struct {
+    seed_t* data;
+    int count;
+    int capacity;
+} seeds;
+
+static bool push_seed(int x, int y)
+{
+    if (seeds.count == seeds.capacity) {
+        int capacity = seeds.capacity ? seeds.capacity * 2 : 4096;
+        seed_t* data = realloc(seeds.data, sizeof(seed_t) * capacity);
+        if (!data)
+            return false;
+        seeds.data = data;
+        seeds.capacity = capacity;
+    }
+    seeds.data[seeds.count++] = (seed_t) { x, y };
+    return true;
+}
+
+// one seed per run of `target` in row y between x1 and x2
+static bool push_runs(const grid_t* grid, int x1, int x2, int y, int target)
+{
+    if (y < 0 || y >= grid->height)
+        return true;
+    for (int x = x1; x <= x2; x++) {
+        if (grid->data[grid_index(grid, x, y)] != target)
+            continue;
+        if (!push_seed(x, y))
+            return false;
+        while (x <= x2 && grid->data[grid_index(grid, x, y)] == target) {
+            x++;
+        }
+    }
+    return true;
+}
+
+int brush_flood_fill(grid_t* grid, int x, int y, particle_t particle)
+{
+    if (x < 0 || y < 0 || x >= grid->width || y >= grid->height)
+        return 0;
+    const int target = grid->data[grid_index(grid, x, y)];
+    if (target == (int)particle)
+        return 0;
+
+    int filled = 0;
+    seeds.count = 0;
+    push_seed(x, y);
+    while (seeds.count > 0) {
+        seed_t seed = seeds.data[--seeds.count];
+        const int* data = grid->data;
+        if (data[grid_index(grid, seed.x, seed.y)] != target)
+            continue; // already filled through another seed
+
+        int left = seed.x, right = seed.x;
+        while (left > 0 && data[grid_index(grid, left - 1, seed.y)] == target) {
+            left--;
+        }
+        while (right < grid->width - 1 && data[grid_index(grid, right + 1, seed.y)] == target) {
+            right++;
+        }
+        brush_set_span(grid, left, right, seed.y, particle);
+        filled += right - left + 1;
+
+        if (!push_runs(grid, left, right, seed.y - 1, target) || !push_runs(grid, left, right, seed.y + 1, target)) {
+            fprintf(stderr, "Flood fill: out of memory, region left partially filled\n");
+            break;
+        }
+    }
+    return filled;
+}
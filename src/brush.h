@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "game.h"
+
+// :BRUSH
+// Span based brush rasterization. Every shape is reduced to one span per
+// row, computed once, and each span is filled with a masked write: paint
+// only lands on PARTICLE_AIR, erase (PARTICLE_AIR) overwrites anything.
+// A cell is touched with probability `density`. Coordinates are in cells.
+
+void brush_seed(uint64_t seed);
+
+void brush_fill_span(grid_t* grid, int x1, int x2, int y, particle_t particle, float density);
+void brush_circle(grid_t* grid, int xc, int yc, int r, particle_t particle, float density);
+void brush_rect(grid_t* grid, int x0, int y0, int x1, int y1, particle_t particle, float density);
+// every cell within r of the segment (x0, y0)-(x1, y1), each row filled once
+void brush_capsule(grid_t* grid, int x0, int y0, int x1, int y1, int r, particle_t particle, float density);
+
+// unconditional write of the whole span, no density or AIR check
+void brush_set_span(grid_t* grid, int x1, int x2, int y, particle_t particle);
+// scanline flood fill of the 4-connected region of the material at (x, y),
+// returns the number of cells written
+int brush_flood_fill(grid_t* grid, int x, int y, particle_t particle);
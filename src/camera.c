@@ -0,0 +1,71 @@
+#include "camera.h"
+
+#include <math.h>
+
+void camera_reset(camera_t* camera, float world_width, float world_height)
+{
+    *camera = (camera_t) {
+        .x = world_width / 2.0f,
+        .y = world_height / 2.0f,
+        .zoom = 1.0f,
+    };
+}
+
+void camera_update(camera_t* camera, float dt)
+{
+    if (!camera->follow)
+        return;
+    // exponential approach, frame rate independent
+    float t = 1.0f - expf(-CAMERA_FOLLOW_RATE * dt);
+    camera->x += (camera->follow_x - camera->x) * t;
+    camera->y += (camera->follow_y - camera->y) * t;
+}
+
+void camera_pan(camera_t* camera, float screen_dx, float screen_dy)
+{
+    camera->x -= screen_dx / camera->zoom;
+    camera->y -= screen_dy / camera->zoom;
+}
+
+void camera_zoom_at(camera_t* camera, float screen_w, float screen_h, float sx, float sy, float factor)
+{
+    float wx, wy;
+    camera_screen_to_world(camera, screen_w, screen_h, sx, sy, &wx, &wy);
+    camera->zoom = fminf(fmaxf(camera->zoom * factor, CAMERA_MIN_ZOOM), CAMERA_MAX_ZOOM);
+    camera->x = wx - (sx - screen_w / 2.0f) / camera->zoom;
+    camera->y = wy - (sy - screen_h / 2.0f) / camera->zoom;
+}
+
+void camera_follow(camera_t* camera, float x, float y)
+{
+    camera->follow_x = x;
+    camera->follow_y = y;
+}
+
+void camera_screen_to_world(const camera_t* camera, float screen_w, float screen_h, float sx, float sy, float* wx, float* wy)
+{
+    *wx = camera->x + (sx - screen_w / 2.0f) / camera->zoom;
+    *wy = camera->y + (sy - screen_h / 2.0f) / camera->zoom;
+}
+
+static int clamp_int(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+camera_view_t camera_get_view(const camera_t* camera, float screen_w, float screen_h, int grid_width, int grid_height, float cell_size)
+{
+    camera_view_t view;
+    float half_w = screen_w / 2.0f / camera->zoom;
+    float half_h = screen_h / 2.0f / camera->zoom;
+    view.left = camera->x - half_w;
+    view.right = camera->x + half_w;
+    view.top = camera->y - half_h;
+    view.bottom = camera->y + half_h;
+
+    view.cell_x0 = clamp_int((int)floorf(view.left / cell_size), 0, grid_width);
+    view.cell_y0 = clamp_int((int)floorf(view.top / cell_size), 0, grid_height);
+    view.cell_x1 = clamp_int((int)ceilf(view.right / cell_size), 0, grid_width);
+    view.cell_y1 = clamp_int((int)ceilf(view.bottom / cell_size), 0, grid_height);
+    return view;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+
+// :CAMERA
+// World units are window pixels at zoom 1, the same units the grid was
+// always drawn in (cell * tile_size). Screen units are framebuffer pixels.
+
+#define CAMERA_MIN_ZOOM 0.03125f
+#define CAMERA_MAX_ZOOM 16.0f
+#define CAMERA_FOLLOW_RATE 8.0f // 1/s, how quickly follow closes the distance
+
+typedef struct {
+    float x, y; // world position at the center of the screen
+    float zoom; // screen pixels per world unit
+    bool follow;
+    float follow_x, follow_y;
+} camera_t;
+
+typedef struct {
+    float left, top, right, bottom; // world rect covered by the screen
+    int cell_x0, cell_y0, cell_x1, cell_y1; // visible cells, half open, clamped to the grid
+} camera_view_t;
+
+void camera_reset(camera_t* camera, float world_width, float world_height);
+void camera_update(camera_t* camera, float dt);
+
+void camera_pan(camera_t* camera, float screen_dx, float screen_dy);
+// zooms by `factor`, keeping the world point under (sx, sy) in place
+void camera_zoom_at(camera_t* camera, float screen_w, float screen_h, float sx, float sy, float factor);
+void camera_follow(camera_t* camera, float x, float y);
+
+void camera_screen_to_world(const camera_t* camera, float screen_w, float screen_h, float sx, float sy, float* wx, float* wy);
+camera_view_t camera_get_view(const camera_t* camera, float screen_w, float screen_h, int grid_width, int grid_height, float cell_size);
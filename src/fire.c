@@ -0,0 +1,98 @@
+#include "fire.h"
+
+#include <stdbool.h>
+
+#include "heat.h"
+#include "rng.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static rng_t fire_rng = { 0x2d358dccaa6c78a5ull };
+
+// chance per tick that a burning neighbor sets the material alight
+static const float flammability[PARTICLE_MAX] = {
+    [PARTICLE_WOOD] = 0.04f,
+};
+
+static const uint8_t lifetime[PARTICLE_MAX] = {
+    [PARTICLE_FIRE] = FIRE_LIFETIME,
+    [PARTICLE_SMOKE] = SMOKE_LIFETIME,
+};
+
+// what a temporary material turns into when its lifetime runs out
+static const particle_t expires_into[PARTICLE_MAX] = {
+    [PARTICLE_FIRE] = PARTICLE_SMOKE,
+    [PARTICLE_SMOKE] = PARTICLE_AIR,
+};
+
+void fire_seed(uint64_t seed)
+{
+    fire_rng = make_rng(seed);
+}
+
+static void ignite(grid_t* grid, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= grid->width || y >= grid->height)
+        return;
+    const int i = grid_index(grid, x, y);
+    const float chance = flammability[grid->data[i]];
+    if (chance > 0.0f && rng_chance(&fire_rng, rng_threshold(chance))) {
+        set_cell(grid, i, PARTICLE_FIRE);
+    }
+}
+
+void fire_start_life(grid_t* grid, int x, int y)
+{
+    const int i = grid_index(grid, x, y);
+    if (grid->life[i] == 0)
+        grid->life[i] = lifetime[grid->data[i]];
+}
+
+void fire_update_particle(grid_t* grid, int x, int y)
+{
+    fire_start_life(grid, x, y);
+    heat_raise(x, y, FIRE_TEMPERATURE);
+    ignite(grid, x - 1, y);
+    ignite(grid, x + 1, y);
+    ignite(grid, x, y - 1);
+    ignite(grid, x, y + 1);
+}
+
+// :DECAY
+
+static void expire(grid_t* grid, int i)
+{
+    const particle_t into = expires_into[grid->data[i]];
+    if (into == PARTICLE_NONE)
+        return;
+    set_cell(grid, i, into);
+    grid->life[i] = lifetime[into];
+}
+
+// counts every lifetime down, the plane is walked in storage order
+void fire_step(grid_t* grid)
+{
+    uint8_t* life = grid->life;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= grid->count; i += 16) {
+        __m128i old = _mm_loadu_si128((const __m128i*)(life + i));
+        _mm_storeu_si128((__m128i*)(life + i), _mm_subs_epu8(old, one));
+        // lanes that just reached zero
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(old, one));
+        for (int lane = 0; mask; lane++, mask >>= 1) {
+            if (mask & 1)
+                expire(grid, i + lane);
+        }
+    }
+#endif
+    for (; i < grid->count; i++) {
+        if (life[i] == 0)
+            continue;
+        if (--life[i] == 0)
+            expire(grid, i);
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "game.h"
+
+// :FIRE
+// Fire and smoke are temporary materials. Their remaining lifetime in ticks
+// is kept in grid->life, one byte per cell next to the material. A new cell
+// starts at 0 and is given its full lifetime the first time it is updated.
+// fire_step() counts every lifetime down in one vectorized pass; a cell
+// whose lifetime runs out turns into what it expires into (fire leaves
+// smoke, smoke leaves air).
+//
+// Burning cells ignite flammable neighbors at random and keep their heat
+// block at flame temperature, so fire also spreads through the heat field.
+// Smoke moves with the other gases, see gas.h.
+
+#define FIRE_LIFETIME 60
+#define SMOKE_LIFETIME 120
+#define FIRE_TEMPERATURE 600.0f
+
+void fire_seed(uint64_t seed);
+
+// per cell from fixed_update, the kernel of fire
+void fire_update_particle(grid_t* grid, int x, int y);
+// per cell from fixed_update, gives a new temporary cell its lifetime
+void fire_start_life(grid_t* grid, int x, int y);
+// once per tick after fixed_update
+void fire_step(grid_t* grid);
@@ -0,0 +1,450 @@
+#include "game.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "brush.h"
+#include "fire.h"
+#include "margolus.h"
+#include "occupancy.h"
+#include "plugin.h"
+#include "rng.h"
+#include "sandboard.h"
+
+struct game_state_t game_state;
+
+static rng_t game_rng = { 0x9e3779b97f4a7c15ull };
+static int swept_moved; // cells try_sink swapped during the last fixed_update
+
+#define X(enum_item, ...) #enum_item,
+static const char* particle_name[] = {
+    PARTICLE_ENUM
+};
+#undef X
+#define X(_, color, ...) RGBA_TO_ABGR(color),
+static uint32_t particle_color[] = {
+    PARTICLE_ENUM
+};
+#undef X
+#define X(enum_item, color, density, ...) density,
+static int particle_density[] = {
+    PARTICLE_ENUM
+};
+#undef X
+#define X(enum_item, color, density, movement) movement,
+static uint8_t particle_movement[] = {
+    PARTICLE_ENUM
+};
+#undef X
+
+const char* particle_get_name(particle_t particle)
+{
+    return particle_name[particle];
+}
+
+uint32_t particle_get_color(particle_t e_particle)
+{
+    return particle_color[e_particle];
+}
+
+int particle_get_density(particle_t particle)
+{
+    return particle_density[particle];
+}
+
+movement_t particle_get_movement(particle_t particle)
+{
+    return particle_movement[particle];
+}
+
+// :DISPLACEMENT
+
+// materials others can move through
+static bool fluid[PARTICLE_MAX] = {
+    [PARTICLE_AIR] = true,
+    [PARTICLE_WATER] = true,
+    [PARTICLE_STEAM] = true,
+    [PARTICLE_SMOKE] = true,
+};
+
+// chance per tick of sinking into a lighter fluid, pairs not listed always sink
+static const float sink_chance[PARTICLE_MAX][PARTICLE_MAX] = {
+    [PARTICLE_SAND][PARTICLE_WATER] = 0.5f,
+    [PARTICLE_WET_SAND][PARTICLE_WATER] = 0.5f,
+    [PARTICLE_DIRT][PARTICLE_WATER] = 0.3f,
+    [PARTICLE_MUD][PARTICLE_WATER] = 0.3f,
+};
+
+// chance per tick that a powder blocked below slides off diagonally, wet material holds together
+static float slide_chance[PARTICLE_MAX] = {
+    [PARTICLE_SAND] = 1.0f,
+    [PARTICLE_DIRT] = 1.0f,
+    [PARTICLE_WET_SAND] = 0.15f,
+    [PARTICLE_MUD] = 0.4f,
+};
+
+_Static_assert(PARTICLE_MAX <= 32, "displacement masks hold one bit per material");
+
+static struct {
+    bool built;
+    uint32_t sinks[PARTICLE_MAX];
+    uint32_t rises[PARTICLE_MAX];
+    uint32_t thresholds[PARTICLE_MAX][PARTICLE_MAX];
+    uint32_t slide[PARTICLE_MAX];
+} displace;
+
+static void build_displace(void)
+{
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        displace.sinks[m] = displace.rises[m] = 0;
+        displace.slide[m] = rng_threshold(slide_chance[m]);
+        for (int n = 0; n < PARTICLE_MAX; n++) {
+            const float chance = sink_chance[m][n] > 0.0f ? sink_chance[m][n] : 1.0f;
+            displace.thresholds[m][n] = rng_threshold(chance);
+            if (!fluid[n])
+                continue;
+            if (particle_density[n] < particle_density[m])
+                displace.sinks[m] |= 1u << n;
+            if (particle_density[n] > particle_density[m])
+                displace.rises[m] |= 1u << n;
+        }
+    }
+    displace.built = true;
+}
+
+uint32_t particle_sinks_through(particle_t particle)
+{
+    if (!displace.built)
+        build_displace();
+    return displace.sinks[particle];
+}
+
+uint32_t particle_rises_through(particle_t particle)
+{
+    if (!displace.built)
+        build_displace();
+    return displace.rises[particle];
+}
+
+uint32_t particle_sink_threshold(particle_t particle, particle_t fluid)
+{
+    if (!displace.built)
+        build_displace();
+    return displace.thresholds[particle][fluid];
+}
+
+uint32_t particle_slide_threshold(particle_t particle)
+{
+    if (!displace.built)
+        build_displace();
+    return displace.slide[particle];
+}
+
+void particle_define(particle_t particle, const char* name, uint32_t color, int density, movement_t movement, bool is_fluid)
+{
+    assert(particle >= PARTICLE_PLUGIN_0 && particle < PARTICLE_MAX && "Only plugin slots can be defined");
+    particle_name[particle] = name;
+    particle_color[particle] = RGBA_TO_ABGR(color);
+    particle_density[particle] = density;
+    particle_movement[particle] = (uint8_t)movement;
+    fluid[particle] = is_fluid;
+    slide_chance[particle] = movement == MOVE_POWDER ? 1.0f : 0.0f;
+    displace.built = false;
+}
+
+// swaps (x, y) with (tx, ty) when the material there is a lighter fluid and the pair's roll succeeds
+static bool try_sink(grid_t* grid, int x, int y, int tx, int ty)
+{
+    if (tx < 0 || ty < 0 || tx >= grid->width || ty >= grid->height)
+        return false;
+    const int i = grid_index(grid, x, y);
+    const int j = grid_index(grid, tx, ty);
+    const int self = grid->data[i];
+    const int other = grid->data[j];
+    if (!(displace.sinks[self] & 1u << other))
+        return false;
+    const uint32_t threshold = displace.thresholds[self][other];
+    if (threshold < 65536 && !rng_chance(&game_rng, threshold))
+        return false;
+    swap_cells(grid, i, j);
+    swept_moved++;
+    return true;
+}
+#define X(enum_item) #enum_item,
+const char* tool_get_name(tool_t tool)
+{
+    static const char* names[] = {
+        TOOL_ENUM
+    };
+    return names[tool];
+}
+#undef X
+
+#define X(enum_item) #enum_item,
+const char* engine_get_name(engine_t engine)
+{
+    static const char* names[] = {
+        ENGINE_ENUM
+    };
+    return names[engine];
+}
+#undef X
+
+void make_grid(grid_t* grid, int tile_size)
+{
+    grid->width = WIDTH / tile_size;
+    grid->height = HEIGHT / tile_size;
+#if defined(GRID_TILED)
+    grid->count = (grid->width + GRID_TILE - 1) / GRID_TILE * GRID_TILE * ((grid->height + GRID_TILE - 1) / GRID_TILE * GRID_TILE);
+#else
+    grid->count = grid->width * grid->height;
+#endif
+    grid->tile_size = tile_size;
+    assert(grid->count <= MAX_GRID_COUNT && "MAX_GRID_COUNT exceeded");
+    memset(grid->data, PARTICLE_NONE, sizeof(grid->data[0]) * MAX_GRID_COUNT);
+    memset(grid->life, 0, sizeof(grid->life));
+    memset(grid->moisture, 0, sizeof(grid->moisture));
+    memset(grid->touched, 1, sizeof(grid->touched));
+}
+
+void grid_touch_row(grid_t* grid, int y, int x0, int x1)
+{
+    for (int x = x0; x < x1;) {
+        const int span = grid_span(grid, x) < x1 - x ? grid_span(grid, x) : x1 - x;
+        grid_touch(grid, grid_index(grid, x, y), span);
+        x += span;
+    }
+}
+
+void setup_game(void)
+{
+    make_grid(&game_state.grid, TILE_SIZE);
+    for (int i = 0; i < game_state.grid.count; i++) {
+        game_state.grid.data[i] = PARTICLE_AIR;
+    }
+    game_state.brush.radius = DEFAULT_BRUSH_RADIUS;
+    game_state.brush.element = PARTICLE_SAND;
+    game_state.brush.tool = TOOL_BRUSH;
+    game_state.engine = ENGINE_CLASSIC;
+    game_state.mouse_info.held = MOUSE_NONE;
+    game_state.mouse_info.pos.x = 0.0f;
+    game_state.mouse_info.pos.y = 0.0f;
+    game_state.mouse_info.last = game_state.mouse_info.pos;
+}
+
+particle_t get_tile(int x, int y)
+{
+    if (x < 0 || y < 0 || x >= game_state.grid.width || y >= game_state.grid.height)
+        return PARTICLE_NONE;
+    return game_state.grid.data[grid_index(&game_state.grid, x, y)];
+}
+
+void set_tile(int x, int y, particle_t particle)
+{
+    if (x < 0 || y < 0 || x >= game_state.grid.width || y >= game_state.grid.height)
+        return;
+    set_cell(&game_state.grid, grid_index(&game_state.grid, x, y), particle);
+}
+
+void set_tile_safe(int x, int y, particle_t particle)
+{
+    if (get_tile(x, y) == PARTICLE_AIR) {
+        set_tile(x, y, particle);
+    }
+}
+
+void erase_tile(int x, int y)
+{
+    set_tile(x, y, PARTICLE_AIR);
+}
+
+// converts from window to grid
+void set_tile_from_window(int x, int y, particle_t particle)
+{
+    x = x / game_state.grid.tile_size;
+    y = y / game_state.grid.tile_size;
+    set_tile(x, y, particle);
+}
+
+bool is_empty(int x, int y)
+{
+    particle_t tile = get_tile(x, y);
+    return tile == PARTICLE_AIR;
+}
+
+void draw_horizontal_line(int x1, int x2, int y, particle_t particle)
+{
+    brush_fill_span(&game_state.grid, x1, x2, y, particle, BRUSH_DENSITY);
+}
+
+// filled circle
+void draw_circle(int xc, int yc, int r, particle_t particle)
+{
+    xc = xc / game_state.grid.tile_size;
+    yc = yc / game_state.grid.tile_size;
+    brush_circle(&game_state.grid, xc, yc, r - 1, particle, BRUSH_DENSITY);
+}
+
+// circle swept from (x0, y0) to (x1, y1)
+void draw_stroke(int x0, int y0, int x1, int y1, int r, particle_t particle)
+{
+    int tile_size = game_state.grid.tile_size;
+    brush_capsule(&game_state.grid, x0 / tile_size, y0 / tile_size, x1 / tile_size, y1 / tile_size, r - 1, particle, BRUSH_DENSITY);
+}
+
+// :TOOLS
+
+void draw_rect(int x0, int y0, int x1, int y1, particle_t particle)
+{
+    int tile_size = game_state.grid.tile_size;
+    brush_rect(&game_state.grid, x0 / tile_size, y0 / tile_size, x1 / tile_size, y1 / tile_size, particle, TOOL_DENSITY);
+}
+
+void draw_line(int x0, int y0, int x1, int y1, int r, particle_t particle)
+{
+    int tile_size = game_state.grid.tile_size;
+    brush_capsule(&game_state.grid, x0 / tile_size, y0 / tile_size, x1 / tile_size, y1 / tile_size, r - 1, particle, TOOL_DENSITY);
+}
+
+// replaces the connected region under (x, y), returns the number of cells written
+int fill_region(int x, int y, particle_t particle)
+{
+    int tile_size = game_state.grid.tile_size;
+    return brush_flood_fill(&game_state.grid, x / tile_size, y / tile_size, particle);
+}
+
+void game_seed(uint64_t seed)
+{
+    game_rng = make_rng(seed);
+}
+
+// :KERNELS
+// One per movement class, picked from the movement column of PARTICLE_ENUM.
+
+typedef void (*kernel_t)(grid_t* grid, int x, int y, particle_t particle);
+
+// sinks straight down, then slides off diagonally
+static void update_powder(grid_t* grid, int x, int y, particle_t particle)
+{
+    if (try_sink(grid, x, y, x, y + 1))
+        return;
+    const uint32_t slide = displace.slide[particle];
+    if ((slide >= 65536 || rng_chance(&game_rng, slide)) && !try_sink(grid, x, y, x - 1, y + 1))
+        try_sink(grid, x, y, x + 1, y + 1);
+}
+
+// falls like a powder, then flows sideways, trying a random side first
+static void update_liquid(grid_t* grid, int x, int y, particle_t particle)
+{
+    (void)particle;
+    const int dx = rng_next(&game_rng) & 1 ? 1 : -1;
+    if (!try_sink(grid, x, y, x, y + 1) && !try_sink(grid, x, y, x + dx, y + 1) && !try_sink(grid, x, y, x - dx, y + 1)
+        && !try_sink(grid, x, y, x + dx, y))
+        try_sink(grid, x, y, x - dx, y);
+}
+
+static void update_gas(grid_t* grid, int x, int y, particle_t particle)
+{
+    (void)particle;
+    fire_start_life(grid, x, y);
+}
+
+static void update_fire(grid_t* grid, int x, int y, particle_t particle)
+{
+    (void)particle;
+    fire_update_particle(grid, x, y);
+}
+
+static void update_plugin(grid_t* grid, int x, int y, particle_t particle)
+{
+    plugin_update_cell(grid, x, y, particle);
+}
+
+static const kernel_t kernels[MOVE_MAX] = {
+    [MOVE_STATIC] = NULL,
+    [MOVE_POWDER] = update_powder,
+    [MOVE_LIQUID] = update_liquid,
+    [MOVE_GAS] = update_gas,
+    [MOVE_FIRE] = update_fire,
+    [MOVE_PLUGIN] = update_plugin,
+};
+
+void update_particle(int x, int y)
+{
+    grid_t* grid = &game_state.grid;
+    if (x < 0 || y < 0 || x >= grid->width || y >= grid->height)
+        return;
+    if (!displace.built)
+        build_displace();
+    const particle_t particle = grid->data[grid_index(grid, x, y)];
+    const kernel_t kernel = kernels[particle_movement[particle]];
+    if (kernel)
+        kernel(grid, x, y, particle);
+}
+
+// runs the kernels of the movement classes in `classes` (bit per class) on
+// row y, skipping the chunks in `stepped`, then the row callbacks of plugins
+static void sweep_row(grid_t* grid, int y, uint64_t stepped, unsigned classes)
+{
+    bool left_to_right = rand() % 100 > 50;
+    const uint32_t* awake = occupancy_awake_row(grid, y);
+    for (int i = 0; i < grid->width; i++) {
+        int x = left_to_right ? i : grid->width - 1 - i;
+        if (stepped >> (x / 64) & 1) {
+            i += left_to_right ? 63 - x % 64 : x % 64;
+            continue;
+        }
+        if (awake && !(awake[x / 32] >> (x % 32) & 1)) {
+            if (!awake[x / 32])
+                i += left_to_right ? 31 - x % 32 : x % 32;
+            continue;
+        }
+        const particle_t particle = grid->data[grid_index(grid, x, y)];
+        const movement_t movement = particle_movement[particle];
+        if (classes >> movement & 1)
+            kernels[movement](grid, x, y, particle);
+    }
+    if (classes >> MOVE_PLUGIN & 1)
+        plugin_update_row(grid, y);
+}
+
+// static cells are skipped without a call, and with occupancy set up so are
+// cells that cannot move, whole words of 32 at a time (see occupancy.h);
+// chunks of sand and air the bitboard engine stepped are skipped too, see
+// sandboard.h
+//
+// ENGINE_MARGOLUS moves powders and liquids with margolus_step() instead,
+// the sweep then only runs the gas, fire and plugin kernels
+void fixed_update(void)
+{
+    if (!displace.built)
+        build_displace();
+    grid_t* grid = &game_state.grid;
+    swept_moved = 0;
+    if (game_state.engine == ENGINE_MARGOLUS) {
+        margolus_step(grid);
+        for (int y = grid->height - 1; y >= 0; y--) {
+            sweep_row(grid, y, 0, 1u << MOVE_GAS | 1u << MOVE_FIRE | 1u << MOVE_PLUGIN);
+        }
+        return;
+    }
+    const unsigned classes = 1u << MOVE_POWDER | 1u << MOVE_LIQUID | 1u << MOVE_GAS | 1u << MOVE_FIRE | 1u << MOVE_PLUGIN;
+    const int chunks = (grid->width + 63) / 64;
+    const uint64_t all_chunks = chunks >= 64 ? ~0ull : (1ull << chunks) - 1;
+    for (int y1 = grid->height; y1 > 0; y1 -= SANDBOARD_ROWS) {
+        const int y0 = y1 > SANDBOARD_ROWS ? y1 - SANDBOARD_ROWS : 0;
+        const uint64_t stepped = sandboard_step(grid, y0, y1);
+        if (stepped == all_chunks)
+            continue;
+        for (int y = y1 - 1; y >= y0; y--) {
+            sweep_row(grid, y, stepped, classes);
+        }
+    }
+}
+
+int fixed_update_moved(void)
+{
+    const int engine_moved = game_state.engine == ENGINE_MARGOLUS ? margolus_stats().moved : sandboard_stats().moved;
+    return swept_moved + engine_moved;
+}
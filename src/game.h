@@ -0,0 +1,297 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// :Game Settings
+
+#define WIDTH 1600
+#define HEIGHT 1000
+
+#define TILE_SIZE 4
+#define DEFAULT_BRUSH_RADIUS 3
+#define BRUSH_DENSITY 0.25f
+#define TOOL_DENSITY 1.0f
+#define HEAT_TOOL_DELTA 60.0f // degrees per tick under the heat brush
+
+// :GAME
+
+#define MAX_GRID_COUNT (1920 * 1080)
+#define GRID_BLOCK 64 // stored cells per touched flag
+typedef struct {
+    int data[MAX_GRID_COUNT];
+    uint8_t life[MAX_GRID_COUNT]; // ticks left for temporary materials, see fire.h
+    uint8_t moisture[MAX_GRID_COUNT]; // water soaked into porous materials, see moisture.h
+    uint8_t touched[MAX_GRID_COUNT / GRID_BLOCK]; // blocks whose materials changed, see grid_touch()
+    int count;
+    int width;
+    int height;
+    int tile_size;
+} grid_t;
+
+// :LAYOUT
+// The planes of grid_t are row major, or with GRID_TILED defined (the
+// SIM_GRID_TILED build option) made of GRID_TILE x GRID_TILE tiles stored one
+// after the other, so the cells above and below a cell are usually in the
+// same few cache lines. Code that walks the grid goes through grid_index()
+// for single cells and grid_span() for runs of a row: a span is the rest of
+// the row when row major and the rest of a tile row when tiled. count is the
+// size of the planes, padding included.
+
+#if defined(GRID_TILED)
+#define GRID_TILE 8
+_Static_assert(GRID_TILE * GRID_TILE == GRID_BLOCK, "a touched flag covers one tile");
+#endif
+_Static_assert(MAX_GRID_COUNT % GRID_BLOCK == 0, "touched flags cover the whole grid");
+
+static inline int grid_index(const grid_t* grid, int x, int y)
+{
+#if defined(GRID_TILED)
+    const unsigned tiles_x = ((unsigned)grid->width + GRID_TILE - 1) / GRID_TILE;
+    const unsigned ux = (unsigned)x, uy = (unsigned)y;
+    return (int)(((uy / GRID_TILE) * tiles_x + ux / GRID_TILE) * (GRID_TILE * GRID_TILE) + (uy % GRID_TILE) * GRID_TILE + ux % GRID_TILE);
+#else
+    return x + y * grid->width;
+#endif
+}
+
+// cells of the row stored one after the other from column x
+static inline int grid_span(const grid_t* grid, int x)
+{
+#if defined(GRID_TILED)
+    const int span = GRID_TILE - x % GRID_TILE;
+    return span < grid->width - x ? span : grid->width - x;
+#else
+    return grid->width - x;
+#endif
+}
+
+// row y in row major order: into the grid when it is row major, else
+// gathered into `scratch`, which holds width cells
+static inline const int* grid_row(const grid_t* grid, int y, int* scratch)
+{
+#if defined(GRID_TILED)
+    for (int x = 0; x < grid->width;) {
+        const int* cells = grid->data + grid_index(grid, x, y);
+        for (int span = grid_span(grid, x); span > 0; span--) {
+            scratch[x++] = *cells++;
+        }
+    }
+    return scratch;
+#else
+    (void)scratch;
+    return grid->data + y * grid->width;
+#endif
+}
+
+// clang-format off
+#define RGBA_TO_ABGR(color) (                  \
+    ((((uint32_t)color) & 0xff000000) >> 24) | \
+    ((((uint32_t)color) & 0x00ff0000) >> 8)  | \
+    ((((uint32_t)color) & 0x0000ff00) << 8)  | \
+    ((((uint32_t)color) & 0x000000ff) << 24))
+// clang-format on
+
+// how fixed_update treats a material, each class has its own kernel
+typedef enum {
+    MOVE_STATIC, // never visited: air, solids
+    MOVE_POWDER, // falls and piles up
+    MOVE_LIQUID, // falls and flows sideways
+    MOVE_GAS, // moved by gas_step, only its lifetime starts here
+    MOVE_FIRE, // stays put, burns its neighbors
+    MOVE_PLUGIN, // moved by the callbacks of a plugin material, see plugin.h
+    MOVE_MAX,
+} movement_t;
+
+// enum, color, density (water is 100), movement; the PARTICLE_PLUGIN_ slots
+// stay unused until plugin_load() fills them in, see plugin.h
+#define PARTICLE_ENUM                                  \
+    X(PARTICLE_NONE, 0x00000000, 0, MOVE_STATIC)       \
+    X(PARTICLE_AIR, 0x48beffff, 12, MOVE_STATIC)       \
+    X(PARTICLE_SAND, 0xf7dba7ff, 160, MOVE_POWDER)     \
+    X(PARTICLE_WOOD, 0xa1662fff, 60, MOVE_STATIC)      \
+    X(PARTICLE_WATER, 0x1ca3ecff, 100, MOVE_LIQUID)    \
+    X(PARTICLE_STEAM, 0xd8e4e8ff, 6, MOVE_GAS)         \
+    X(PARTICLE_GLASS, 0xb8dcd6ff, 250, MOVE_STATIC)    \
+    X(PARTICLE_FIRE, 0xff6a1aff, 3, MOVE_FIRE)         \
+    X(PARTICLE_SMOKE, 0x5a5a5eff, 9, MOVE_GAS)         \
+    X(PARTICLE_DIRT, 0x7a5535ff, 130, MOVE_POWDER)     \
+    X(PARTICLE_WET_SAND, 0xc2a06cff, 190, MOVE_POWDER) \
+    X(PARTICLE_MUD, 0x4e3a2aff, 170, MOVE_POWDER)      \
+    X(PARTICLE_PLUGIN_0, 0x00000000, 0, MOVE_STATIC)   \
+    X(PARTICLE_PLUGIN_1, 0x00000000, 0, MOVE_STATIC)   \
+    X(PARTICLE_PLUGIN_2, 0x00000000, 0, MOVE_STATIC)   \
+    X(PARTICLE_PLUGIN_3, 0x00000000, 0, MOVE_STATIC)   \
+    X(PARTICLE_MAX, 0x00000000, 0, MOVE_STATIC)
+
+// X(PARTICLE_SAND, 0xf6d7b0ff)
+// X(PARTICLE_SAND, 0xe5be9eff)
+// X(PARTICLE_AIR, 0x89c2d9ff)
+// X(PARTICLE_AIR, 0x87ceebff)
+
+#define X(enum_item, ...) enum_item,
+typedef enum {
+    PARTICLE_ENUM
+} particle_t;
+#undef X
+
+const char* particle_get_name(particle_t particle);
+uint32_t particle_get_color(particle_t e_particle);
+int particle_get_density(particle_t particle);
+movement_t particle_get_movement(particle_t particle);
+// bit n set: material n is a fluid (air, water, gas) lighter than `particle`, which sinks through it
+uint32_t particle_sinks_through(particle_t particle);
+// bit n set: material n is a fluid denser than `particle`, which rises through it
+uint32_t particle_rises_through(particle_t particle);
+// chance per tick that `particle` sinks into `fluid` when it may, 65536 is always, see rng_threshold
+uint32_t particle_sink_threshold(particle_t particle, particle_t fluid);
+// chance per tick that a powder blocked below slides off diagonally, same units
+uint32_t particle_slide_threshold(particle_t particle);
+// fills in a PARTICLE_PLUGIN_ slot before the simulation starts, `name`
+// must outlive it; fluid: others sink or rise through it
+void particle_define(particle_t particle, const char* name, uint32_t color, int density, movement_t movement, bool fluid);
+
+#define TOOL_ENUM     \
+    X(TOOL_BRUSH)     \
+    X(TOOL_BUCKET)    \
+    X(TOOL_RECTANGLE) \
+    X(TOOL_LINE)      \
+    X(TOOL_HEAT)
+
+#define X(enum_item) enum_item,
+typedef enum {
+    TOOL_ENUM
+} tool_t;
+#undef X
+
+const char* tool_get_name(tool_t tool);
+
+// what fixed_update moves cells with: the bottom up sweep of per class
+// kernels, or 2x2 blocks through a lookup table, see margolus.h
+#define ENGINE_ENUM   \
+    X(ENGINE_CLASSIC) \
+    X(ENGINE_MARGOLUS)
+
+#define X(enum_item) enum_item,
+typedef enum {
+    ENGINE_ENUM
+    ENGINE_MAX,
+} engine_t;
+#undef X
+
+const char* engine_get_name(engine_t engine);
+
+struct game_state_t {
+    grid_t grid;
+    struct {
+        int radius;
+        particle_t element;
+        tool_t tool;
+    } brush;
+    engine_t engine; // owned by the simulation like the brush
+    struct {
+        enum {
+            MOUSE_NONE,
+            MOUSE_LEFT,
+            MOUSE_RIGHT,
+        } held;
+        struct {
+            float x, y;
+        } pos, last, anchor; // pos: screen, last: world position the brush was last applied at, anchor: world position the drag started at
+        bool panning;
+        struct {
+            float x, y;
+        } scroll;
+    } mouse_info;
+};
+extern struct game_state_t game_state;
+
+// :TOUCHED
+// Every write of a material flags the block of GRID_BLOCK stored cells it
+// falls in, a tile when GRID_TILED. The occupancy planes repack the flagged
+// blocks and clear the flags, see occupancy.h; swap_span(), swap_cells() and
+// set_cell() flag for their callers, code writing grid->data itself calls
+// grid_touch() or grid_touch_row().
+
+// flags the `count` cells stored one after the other from i
+static inline void grid_touch(grid_t* grid, int i, int count)
+{
+    for (int block = i / GRID_BLOCK; block <= (i + count - 1) / GRID_BLOCK; block++) {
+        grid->touched[block] = 1;
+    }
+}
+
+// flags the cells [x0, x1) of row y
+void grid_touch_row(grid_t* grid, int y, int x0, int x1);
+
+// swaps `count` cells stored one after the other from a and from b
+static inline void swap_span(grid_t* grid, int a, int b, int count)
+{
+    grid_touch(grid, a, count);
+    grid_touch(grid, b, count);
+    for (int i = 0; i < count; i++) {
+        const int material = grid->data[a + i];
+        grid->data[a + i] = grid->data[b + i];
+        grid->data[b + i] = material;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint8_t life = grid->life[a + i];
+        grid->life[a + i] = grid->life[b + i];
+        grid->life[b + i] = life;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint8_t moisture = grid->moisture[a + i];
+        grid->moisture[a + i] = grid->moisture[b + i];
+        grid->moisture[b + i] = moisture;
+    }
+}
+
+// moves a cell with everything stored next to its material
+static inline void swap_cells(grid_t* grid, int a, int b)
+{
+    grid_touch(grid, a, 1);
+    grid_touch(grid, b, 1);
+    const int material = grid->data[a];
+    grid->data[a] = grid->data[b];
+    grid->data[b] = material;
+    const uint8_t life = grid->life[a];
+    grid->life[a] = grid->life[b];
+    grid->life[b] = life;
+    const uint8_t moisture = grid->moisture[a];
+    grid->moisture[a] = grid->moisture[b];
+    grid->moisture[b] = moisture;
+}
+
+// puts a new material in cell i, what the old one kept in the life and
+// moisture planes is cleared; cells that move go through swap_cells()
+static inline void set_cell(grid_t* grid, int i, particle_t particle)
+{
+    grid_touch(grid, i, 1);
+    grid->data[i] = particle;
+    grid->life[i] = 0;
+    grid->moisture[i] = 0;
+}
+
+void make_grid(grid_t* grid, int tile_size);
+void setup_game(void);
+
+particle_t get_tile(int x, int y);
+void set_tile(int x, int y, particle_t particle);
+void set_tile_safe(int x, int y, particle_t particle);
+void erase_tile(int x, int y);
+void set_tile_from_window(int x, int y, particle_t particle);
+bool is_empty(int x, int y);
+
+void draw_horizontal_line(int x1, int x2, int y, particle_t particle);
+void draw_circle(int xc, int yc, int r, particle_t particle);
+void draw_stroke(int x0, int y0, int x1, int y1, int r, particle_t particle);
+void draw_rect(int x0, int y0, int x1, int y1, particle_t particle);
+void draw_line(int x0, int y0, int x1, int y1, int r, particle_t particle);
+int fill_region(int x, int y, particle_t particle);
+
+// seeds the powder slide, liquid side and sink chance rolls of fixed_update
+void game_seed(uint64_t seed);
+void update_particle(int x, int y);
+void fixed_update(void);
+// cells the last fixed_update() moved, plugin callbacks not included
+int fixed_update_moved(void);
@@ -0,0 +1,102 @@
+#include "gas.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rng.h"
+#include "runs.h"
+
+static const particle_t gases[] = { PARTICLE_STEAM, PARTICLE_SMOKE };
+
+static rng_t gas_rng = { 0x510e527fade682d1ull };
+
+static struct {
+    uint32_t* row; // gas bits of the row being visited
+    int words;
+    int width;
+    uint32_t displaces[PARTICLE_MAX]; // bit n set: moves into material n
+    uint32_t spread;
+} gas;
+
+bool gas_init(const grid_t* grid)
+{
+    gas_shutdown();
+    gas.width = grid->width;
+    gas.words = (grid->width + 31) / 32;
+    gas.row = calloc(gas.words, sizeof(uint32_t));
+    if (!gas.row)
+        return false;
+
+    for (size_t g = 0; g < sizeof(gases) / sizeof(gases[0]); g++) {
+        gas.displaces[gases[g]] = particle_rises_through(gases[g]);
+    }
+    gas.spread = rng_threshold(GAS_SPREAD);
+    return true;
+}
+
+void gas_shutdown(void)
+{
+    free(gas.row);
+    memset(&gas, 0, sizeof(gas));
+}
+
+void gas_seed(uint64_t seed)
+{
+    gas_rng = make_rng(seed);
+}
+
+static bool try_move(grid_t* grid, int x, int y, int tx, int ty)
+{
+    if (tx < 0 || tx >= grid->width || ty < 0)
+        return false;
+    const int here = grid_index(grid, x, y);
+    const int there = grid_index(grid, tx, ty);
+    if (!(gas.displaces[grid->data[here]] & 1u << grid->data[there]))
+        return false;
+    swap_cells(grid, here, there);
+    return true;
+}
+
+// rows above y were already visited this tick, so a gas moves at most one row
+static void move_gas(grid_t* grid, int x, int y)
+{
+    const int dx = rng_next(&gas_rng) & 1 ? 1 : -1;
+    if (try_move(grid, x, y, x, y - 1) || try_move(grid, x, y, x + dx, y - 1) || try_move(grid, x, y, x - dx, y - 1))
+        return;
+    if (!rng_chance(&gas_rng, gas.spread))
+        return;
+    int tx = x + dx;
+    if (!try_move(grid, x, y, tx, y)) {
+        tx = x - dx;
+        if (!try_move(grid, x, y, tx, y))
+            return;
+    }
+    // whatever was displaced into x is not visited again, nor is the gas at tx
+    gas.row[tx / 32] &= ~(1u << (tx % 32));
+}
+
+void gas_step(grid_t* grid)
+{
+    if (!gas.row || grid->width != gas.width)
+        return;
+    const int gas_count = sizeof(gases) / sizeof(gases[0]);
+    for (int y = 0; y < grid->height; y++) {
+        if (!pack_row(grid, y, gases, gas_count, gas.row))
+            continue;
+        if (rng_next(&gas_rng) & 1) {
+            for (int w = 0; w < gas.words; w++) {
+                for (int b = 0; b < 32 && gas.row[w] >> b; b++) {
+                    if (gas.row[w] >> b & 1)
+                        move_gas(grid, w * 32 + b, y);
+                }
+            }
+        } else {
+            for (int w = gas.words - 1; w >= 0; w--) {
+                for (int b = 31; b >= 0 && gas.row[w]; b--) {
+                    if (gas.row[w] >> b & 1)
+                        move_gas(grid, w * 32 + b, y);
+                }
+            }
+        }
+    }
+}
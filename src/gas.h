@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :GAS
+// Steam and smoke rise, drift diagonally and spread sideways through air
+// and through any fluid denser than themselves, so steam bubbles up through
+// a layer of smoke. Who displaces whom comes from the density column of
+// PARTICLE_ENUM.
+//
+// The pass runs top down with its own random scan direction per row. Each
+// row is packed into one bit per cell before it is visited; rows and 32 cell
+// words without gas are skipped, so a mostly empty sky costs one vectorized
+// compare per cell.
+
+#define GAS_SPREAD 0.5f // chance per tick that a gas blocked from rising moves sideways
+
+bool gas_init(const grid_t* grid);
+void gas_shutdown(void);
+void gas_seed(uint64_t seed);
+
+// once per tick after fire_step
+void gas_step(grid_t* grid);
@@ -0,0 +1,1004 @@
+#include <stdio.h>
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "brush.h"
+#include "fire.h"
+#include "game.h"
+#include "gas.h"
+#include "heat.h"
+#include "liquid.h"
+#include "lod.h"
+#include "margolus.h"
+#include "metrics.h"
+#include "moisture.h"
+#include "occupancy.h"
+#include "plugin.h"
+#include "raster.h"
+#include "react.h"
+#include "record.h"
+#include "rigid.h"
+#include "runs.h"
+#include "sandboard.h"
+#include "share.h"
+#include "sim.h"
+#include "thread.h"
+
+// Runs the simulation without a window and captures frames on the CPU.
+// Used on CI and render machines that have no GPU, and to benchmark the
+// render path without sokol_gfx.
+
+typedef enum {
+    FORMAT_NONE,
+    FORMAT_PPM,
+    FORMAT_PNG,
+} image_format_t;
+
+static struct {
+    int frames;
+    int ticks_per_frame;
+    int threads;
+    unsigned seed;
+    const char* out_dir;
+    image_format_t format;
+    const char* bench;
+    engine_t engine;
+    const char* share; // shm name
+    metrics_desc_t metrics;
+    record_desc_t record;
+} options = {
+    .frames = 120,
+    .ticks_per_frame = 1,
+    .threads = 0,
+    .seed = 1,
+    .out_dir = ".",
+    .format = FORMAT_PNG,
+    .bench = NULL,
+    .engine = ENGINE_CLASSIC,
+    .share = NULL,
+    .record = {
+        .path = NULL,
+        .source = RECORD_SOURCE_GRID,
+        .format = RECORD_FORMAT_DELTA,
+        .every_n = 1,
+        .fps = 60,
+        .lossless = true,
+    },
+};
+
+static bool bench_failed; // set by a bench whose check failed, --bench then exits with 1
+
+static void usage(const char* exe)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --frames N     frames to capture (default 120)\n"
+        "  --ticks N      fixed updates per captured frame (default 1)\n"
+        "  --threads N    render threads, 0 -> all cores (default 0)\n"
+        "  --seed N       rand() seed (default 1)\n"
+        "  --out DIR      output directory (default .)\n"
+        "  --format F     png, ppm or none (default png)\n"
+        "  --bench NAME   time raster, update, brush, fill, lod, heat, fire, react, liquid, rigid, gas, moisture, layout, occupancy, sandboard or margolus, writes nothing,\n"
+        "                 exits with 1 when rigid bodies do not come to rest or an engine loses sand\n"
+        "  --engine E     classic or margolus (default classic)\n"
+        "  --plugin FILE  load a material plugin, see plugin_api.h, may be repeated\n"
+        "  --share NAME   publish every tick to the shared memory segment NAME, see share.h\n"
+        "  --metrics FILE  append a JSON line of metrics to FILE, see metrics.h\n"
+        "  --metrics-every N  one line every N ticks instead of once a second\n"
+        "  --record FILE  also record every tick through the background writer\n"
+        "  --record-format raw|y4m|delta (default delta)\n"
+        "  --record-source grid|rgba (default grid)\n"
+        "  --record-every N  record one tick out of N (default 1)\n",
+        exe);
+}
+
+static bool parse_args(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) {
+            usage(argv[0]);
+            return false;
+        }
+        i++;
+        if (strcmp(arg, "--frames") == 0) {
+            options.frames = atoi(value);
+        } else if (strcmp(arg, "--ticks") == 0) {
+            options.ticks_per_frame = atoi(value);
+        } else if (strcmp(arg, "--threads") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.seed = (unsigned)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--bench") == 0) {
+            options.bench = value;
+        } else if (strcmp(arg, "--engine") == 0) {
+            if (strcmp(value, "classic") == 0) {
+                options.engine = ENGINE_CLASSIC;
+            } else if (strcmp(value, "margolus") == 0) {
+                options.engine = ENGINE_MARGOLUS;
+            } else {
+                usage(argv[0]);
+                return false;
+            }
+        } else if (strcmp(arg, "--plugin") == 0) {
+            if (!plugin_load(value))
+                return false;
+        } else if (strcmp(arg, "--share") == 0) {
+            options.share = value;
+        } else if (strcmp(arg, "--metrics") == 0) {
+            options.metrics.path = value;
+        } else if (strcmp(arg, "--metrics-every") == 0) {
+            options.metrics.every_n = atoi(value);
+        } else if (strcmp(arg, "--out") == 0) {
+            options.out_dir = value;
+        } else if (strcmp(arg, "--format") == 0) {
+            if (strcmp(value, "png") == 0) {
+                options.format = FORMAT_PNG;
+            } else if (strcmp(value, "ppm") == 0) {
+                options.format = FORMAT_PPM;
+            } else if (strcmp(value, "none") == 0) {
+                options.format = FORMAT_NONE;
+            } else {
+                usage(argv[0]);
+                return false;
+            }
+        } else if (strcmp(arg, "--record") == 0) {
+            options.record.path = value;
+        } else if (strcmp(arg, "--record-format") == 0) {
+            if (strcmp(value, "raw") == 0) {
+                options.record.format = RECORD_FORMAT_RAW;
+            } else if (strcmp(value, "y4m") == 0) {
+                options.record.format = RECORD_FORMAT_Y4M;
+            } else if (strcmp(value, "delta") == 0) {
+                options.record.format = RECORD_FORMAT_DELTA;
+            } else {
+                usage(argv[0]);
+                return false;
+            }
+        } else if (strcmp(arg, "--record-source") == 0) {
+            if (strcmp(value, "grid") == 0) {
+                options.record.source = RECORD_SOURCE_GRID;
+            } else if (strcmp(value, "rgba") == 0) {
+                options.record.source = RECORD_SOURCE_RGBA;
+            } else {
+                usage(argv[0]);
+                return false;
+            }
+        } else if (strcmp(arg, "--record-every") == 0) {
+            options.record.every_n = atoi(value);
+        } else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// pours sand onto a wooden shelf with a pool of water below
+static void scene_setup(void)
+{
+    for (int x = WIDTH / 4; x < WIDTH / 2; x += TILE_SIZE) {
+        for (int y = HEIGHT / 2; y < HEIGHT / 2 + 4 * TILE_SIZE; y += TILE_SIZE) {
+            set_tile_from_window(x, y, PARTICLE_WOOD);
+        }
+    }
+    for (int y = HEIGHT - HEIGHT / 8; y < HEIGHT; y += TILE_SIZE) {
+        for (int x = 0; x < WIDTH; x += TILE_SIZE) {
+            set_tile_from_window(x, y, PARTICLE_WATER);
+        }
+    }
+}
+
+static void scene_tick(void)
+{
+    draw_circle(WIDTH * 3 / 8, HEIGHT / 8, DEFAULT_BRUSH_RADIUS * 4, PARTICLE_SAND);
+    sim_step();
+}
+
+static void bench_raster(framebuffer_t* fb)
+{
+    for (int i = 0; i < options.frames / 2; i++) {
+        scene_tick();
+    }
+    raster_grid(fb, &game_state.grid); // warm up
+
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        raster_grid(fb, &game_state.grid);
+    }
+    double elapsed = time_now_ms() - start;
+    double per_frame = elapsed / options.frames;
+    double pixels = (double)fb->width * fb->height;
+    printf("raster_grid: %dx%d px, %d threads, %.3f ms/frame, %.1f Mpx/s\n",
+        fb->width, fb->height, parallel_worker_count(), per_frame, pixels / (per_frame * 1000.0));
+}
+
+static void bench_brush(framebuffer_t* fb)
+{
+    (void)fb;
+    static const int radii[] = { 4, 16, 64, 128, 200 };
+    grid_t* grid = &game_state.grid;
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        int radius = radii[r];
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            // alternate paint and erase so the masked write always has work
+            brush_circle(grid, grid->width / 2, grid->height / 2, radius, i & 1 ? PARTICLE_AIR : PARTICLE_SAND, BRUSH_DENSITY);
+        }
+        double per_stamp = (time_now_ms() - start) / options.frames;
+        double area = 3.14159265 * radius * radius;
+        printf("brush_circle r=%3d: %.4f ms/stamp, %.2f ns/cell\n", radius, per_stamp, per_stamp * 1e6 / area);
+    }
+
+    // a stroke covering 4 radii of travel should cost about its own area
+    for (size_t r = 0; r < 3; r++) {
+        int radius = radii[r];
+        int x0 = grid->width / 2 - 2 * radius, x1 = grid->width / 2 + 2 * radius;
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            brush_capsule(grid, x0, grid->height / 2, x1, grid->height / 2 + radius, radius, i & 1 ? PARTICLE_AIR : PARTICLE_SAND, BRUSH_DENSITY);
+        }
+        double per_stroke = (time_now_ms() - start) / options.frames;
+        double area = 3.14159265 * radius * radius + 2.0 * radius * sqrt(16.0 * radius * radius + radius * radius);
+        printf("brush_capsule r=%3d: %.4f ms/stroke, %.2f ns/cell\n", radius, per_stroke, per_stroke * 1e6 / area);
+    }
+}
+
+static void bench_fill(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    // a maze of wood walls so the fill has to turn corners
+    for (int y = 0; y < grid->height; y += 8) {
+        int gap = (y / 8) % 2 ? 0 : grid->width - 4;
+        brush_rect(grid, 0, y, grid->width - 1, y, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, gap, y, gap + 3, y, PARTICLE_AIR, 1.0f);
+    }
+    long long cells = 0;
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        cells += brush_flood_fill(grid, 1, 1, i & 1 ? PARTICLE_AIR : PARTICLE_WATER);
+    }
+    double per_fill = (time_now_ms() - start) / options.frames;
+    printf("brush_flood_fill: %lld cells/fill, %.4f ms/fill, %.2f ns/cell\n",
+        cells / options.frames, per_fill, per_fill * 1e6 / ((double)cells / options.frames));
+}
+
+static void bench_lod(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    for (int i = 0; i < options.frames / 2; i++) {
+        scene_tick();
+    }
+    lod_t lod;
+    uint64_t* row_tick = calloc(grid->height, sizeof(uint64_t));
+    if (!row_tick || !make_lod(&lod, grid->width, grid->height)) {
+        free(row_tick);
+        fprintf(stderr, "Failed to allocate lod pyramid\n");
+        return;
+    }
+    lod_plane_t plane = { grid->data, row_tick, grid->width, grid->height };
+
+    // every row dirty, the cost of a full rebuild
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        for (int y = 0; y < grid->height; y++) {
+            row_tick[y] = i + 1;
+        }
+        lod_update(&lod, &plane, i + 1);
+    }
+    double full = (time_now_ms() - start) / options.frames;
+
+    // one brush stamp per tick, only its rows are dirty
+    const int radius = DEFAULT_BRUSH_RADIUS * 4;
+    const int xc = grid->width / 2, yc = grid->height / 2;
+    start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        uint64_t tick = options.frames + i + 1;
+        brush_circle(grid, xc, yc, radius, i & 1 ? PARTICLE_AIR : PARTICLE_SAND, BRUSH_DENSITY);
+        for (int y = yc - radius; y <= yc + radius; y++) {
+            row_tick[y] = tick;
+        }
+        lod_update(&lod, &plane, tick);
+    }
+    double incremental = (time_now_ms() - start) / options.frames;
+    printf("lod_update: %d levels, full %.3f ms, one stamp r=%d %.4f ms\n",
+        lod.level_count, full, radius, incremental);
+
+    destroy_lod(&lod);
+    free(row_tick);
+}
+
+// one cell per pixel: a heater held under a pool, then the whole world hot so every chunk is awake
+static void bench_heat(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    make_grid(grid, 1);
+    for (int y = 0; y < grid->height; y++) {
+        brush_set_span(grid, 0, grid->width - 1, y, y > grid->height / 2 ? PARTICLE_WATER : PARTICLE_AIR);
+    }
+    if (!heat_init(grid))
+        return;
+
+    for (int pass = 0; pass < 2; pass++) {
+        const char* name = pass == 0 ? "heater" : "world";
+        double update_ms = 0.0, diffuse_ms = 0.0, transition_ms = 0.0;
+        heat_stats_t stats = { 0 };
+        for (int i = 0; i < options.frames; i++) {
+            if (pass == 0)
+                heat_add(grid->width / 2, grid->height - 1, grid->height / 4, HEAT_TOOL_DELTA);
+            else if (i == 0)
+                heat_add(grid->width / 2, grid->height / 2, grid->width + grid->height, 500.0f);
+            double start = time_now_ms();
+            fixed_update();
+            update_ms += time_now_ms() - start;
+            heat_step(grid);
+            stats = heat_stats();
+            diffuse_ms += stats.diffuse_ms;
+            transition_ms += stats.transition_ms;
+        }
+        double tick_ms = (update_ms + diffuse_ms + transition_ms) / options.frames;
+        printf("heat_step %s: %dx%d cells, %d chunks active, diffuse %.3f ms (%.1f%%), transitions %.3f ms (%.1f%%) of a %.3f ms tick\n",
+            name, grid->width, grid->height, stats.active_chunks,
+            diffuse_ms / options.frames, 100.0 * diffuse_ms / options.frames / tick_ms,
+            transition_ms / options.frames, 100.0 * transition_ms / options.frames / tick_ms, tick_ms);
+    }
+}
+
+// one cell per pixel, a forest of wood lit along its bottom edge
+static void bench_fire(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    make_grid(grid, 1);
+    int wood = 0;
+    for (int y = 0; y < grid->height; y++) {
+        bool forest = y > grid->height / 2;
+        brush_set_span(grid, 0, grid->width - 1, y, forest ? PARTICLE_WOOD : PARTICLE_AIR);
+        wood += forest ? grid->width : 0;
+    }
+    if (!heat_init(grid) || !gas_init(grid))
+        return;
+    brush_set_span(grid, 0, grid->width - 1, grid->height - 1, PARTICLE_FIRE);
+
+    double start = time_now_ms();
+    double worst = 0.0;
+    for (int i = 0; i < options.frames; i++) {
+        double tick_start = time_now_ms();
+        fixed_update();
+        fire_step(grid);
+        gas_step(grid);
+        heat_step(grid);
+        double tick_ms = time_now_ms() - tick_start;
+        worst = tick_ms > worst ? tick_ms : worst;
+    }
+    double per_tick = (time_now_ms() - start) / options.frames;
+    int counts[PARTICLE_MAX] = { 0 };
+    for (int i = 0; i < grid->count; i++) {
+        counts[grid->data[i]]++;
+    }
+    printf("fire: %d wood cells, after %d ticks %d burning %d smoke %d wood, %.3f ms/tick (worst %.3f)\n",
+        wood, options.frames, counts[PARTICLE_FIRE], counts[PARTICLE_SMOKE], counts[PARTICLE_WOOD], per_tick, worst);
+}
+
+// one cell per pixel, a pool under air, then with a layer of sand on the water
+static void bench_react(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    make_grid(grid, 1);
+    for (int y = 0; y < grid->height; y++) {
+        brush_set_span(grid, 0, grid->width - 1, y, y > grid->height / 2 ? PARTICLE_WATER : PARTICLE_AIR);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (int y = grid->height / 2 - 16; y <= grid->height / 2; y++) {
+                brush_set_span(grid, 0, grid->width - 1, y, PARTICLE_FIRE);
+            }
+        }
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            react_step(grid);
+        }
+        printf("react_step %s: %dx%d cells, %.3f ms/tick\n",
+            pass == 0 ? "inert" : "fire on water", grid->width, grid->height, (time_now_ms() - start) / options.frames);
+    }
+}
+
+// two tanks joined by a pipe along the floor, only the left one filled
+static void bench_liquid(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    const int h = grid->height, w = grid->width;
+    const int floor = h - 2, top = h / 4;
+    const int left0 = w / 8, left1 = w * 3 / 8, right0 = w * 5 / 8, right1 = w * 7 / 8;
+    for (int pass = 0; pass < 2; pass++) {
+        setup_game();
+        brush_rect(grid, left0 - 1, floor + 1, right1 + 1, floor + 1, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, left0 - 1, top, left0 - 1, floor, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, right1 + 1, top, right1 + 1, floor, PARTICLE_WOOD, 1.0f);
+        // inner walls stop just above the floor, the gap is the pipe
+        brush_rect(grid, left1 + 1, top, left1 + 1, floor - 3, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, right0 - 1, top, right0 - 1, floor - 3, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, left1 + 1, floor - 3, right0 - 1, floor - 3, PARTICLE_WOOD, 1.0f);
+        brush_rect(grid, left0, top, left1, floor, PARTICLE_WATER, 1.0f);
+        if (!liquid_init(grid))
+            return;
+
+        int ticks = 0;
+        double solve_ms = 0.0;
+        int solves = 0;
+        for (; ticks < options.frames; ticks++) {
+            fixed_update();
+            if (pass == 1 && (ticks + 1) % LIQUID_INTERVAL == 0) {
+                double start = time_now_ms();
+                liquid_solve(grid);
+                solve_ms += time_now_ms() - start;
+                solves++;
+            }
+            // the surface of each tank, the first row from the top holding water
+            int levels[2] = { floor + 1, floor + 1 };
+            for (int t = 0; t < 2; t++) {
+                const int x = t == 0 ? (left0 + left1) / 2 : (right0 + right1) / 2;
+                for (int y = top; y <= floor; y++) {
+                    if (grid->data[grid_index(grid, x, y)] == PARTICLE_WATER) {
+                        levels[t] = y;
+                        break;
+                    }
+                }
+            }
+            if (abs(levels[0] - levels[1]) <= LIQUID_MIN_DROP)
+                break;
+        }
+        printf(ticks == options.frames ? "liquid %s: tanks did not settle within %d ticks" : "liquid %s: tanks level after %d ticks",
+            pass == 0 ? "cell flow only" : "with solver", ticks);
+        if (solves)
+            printf(", %.3f ms/solve", solve_ms / solves);
+        printf("\n");
+    }
+}
+
+// one cell per pixel, planks dropped over a sand floor next to a standing wall
+static void bench_rigid(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    make_grid(grid, 1);
+    const int w = grid->width, h = grid->height;
+    for (int y = 0; y < h; y++) {
+        brush_set_span(grid, 0, w - 1, y, y >= h - h / 8 ? PARTICLE_SAND : PARTICLE_AIR);
+    }
+    brush_rect(grid, w / 16, h / 4, w / 16 + 8, h - h / 8 - 1, PARTICLE_WOOD, 1.0f);
+    int planks = 0;
+    for (int y = h / 8; y < h / 2; y += h / 16) {
+        for (int x = w / 8; x + w / 16 < w; x += w / 8) {
+            brush_rect(grid, x, y, x + w / 16, y + 2, (planks & 1) ? PARTICLE_GLASS : PARTICLE_WOOD, 1.0f);
+            planks++;
+        }
+    }
+    if (!rigid_init(grid))
+        return;
+
+    int ticks = 0;
+    double falling_ms = 0.0;
+    for (; ticks < options.frames; ticks++) {
+        double start = time_now_ms();
+        rigid_step(grid);
+        falling_ms += time_now_ms() - start;
+        if (!rigid_stats().moving)
+            break;
+    }
+    rigid_stats_t stats = rigid_stats();
+    printf(ticks == options.frames ? "rigid: %d planks did not settle within %d ticks, %d bodies, %.3f ms/tick\n"
+                                    : "rigid: %d planks landed after %d ticks, %d bodies, %.3f ms/tick\n",
+        planks, ticks, stats.bodies, falling_ms / (ticks ? ticks : 1));
+    if (ticks == options.frames)
+        bench_failed = true;
+
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        rigid_step(grid);
+    }
+    printf("rigid at rest: %.3f ms/tick\n", (time_now_ms() - start) / options.frames);
+
+    // a water tank with a wood plank on its floor and a glass plank on its surface
+    for (int y = 0; y < h; y++) {
+        brush_set_span(grid, 0, w - 1, y, y >= h / 2 ? PARTICLE_WATER : PARTICLE_AIR);
+    }
+    for (int y = h - 4; y < h; y++) {
+        brush_set_span(grid, w / 4, w / 2, y, PARTICLE_WOOD);
+    }
+    brush_rect(grid, w / 2 + 8, h / 2 - 4, w * 3 / 4, h / 2 - 1, PARTICLE_GLASS, 1.0f);
+    for (ticks = 0; ticks < options.frames; ticks++) {
+        rigid_step(grid);
+        if (!rigid_stats().moving)
+            break;
+    }
+    int tops[2] = { h, h };
+    for (int y = h - 1; y >= 0; y--) {
+        for (int x = 0; x < w; x++) {
+            const int cell = grid->data[grid_index(grid, x, y)];
+            const int t = cell == PARTICLE_WOOD ? 0 : cell == PARTICLE_GLASS ? 1 : -1;
+            if (t >= 0)
+                tops[t] = y;
+        }
+    }
+    printf(ticks == options.frames ? "rigid in water: did not settle within %d ticks, wood top at row %d, glass top at row %d, surface at row %d\n"
+                                    : "rigid in water: settled after %d ticks, wood top at row %d, glass top at row %d, surface at row %d\n",
+        ticks, tops[0], tops[1], h / 2);
+    if (ticks == options.frames)
+        bench_failed = true;
+}
+
+// one cell per pixel, a few steam vents under a layer of smoke, then a sky full of both
+static void bench_gas(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    for (int pass = 0; pass < 2; pass++) {
+        make_grid(grid, 1);
+        if (!gas_init(grid))
+            return;
+        const int w = grid->width, h = grid->height;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const int i = grid_index(grid, x, y);
+                if (pass == 1) {
+                    set_cell(grid, i, y < h / 2 ? ((x + y * w) & 1 ? PARTICLE_STEAM : PARTICLE_SMOKE) : PARTICLE_AIR);
+                } else {
+                    set_cell(grid, i, y >= h / 4 && y < h / 4 + 8 ? PARTICLE_SMOKE : PARTICLE_AIR);
+                }
+            }
+        }
+
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            if (pass == 0) {
+                for (int x = w / 8; x < w; x += w / 8) {
+                    set_cell(grid, grid_index(grid, x, h - 1), PARTICLE_STEAM);
+                }
+            }
+            gas_step(grid);
+        }
+        double per_tick = (time_now_ms() - start) / options.frames;
+        int counts[PARTICLE_MAX] = { 0 };
+        int top = h;
+        for (int y = h - 1; y >= 0; y--) {
+            for (int x = 0; x < w; x++) {
+                const int cell = grid->data[grid_index(grid, x, y)];
+                counts[cell]++;
+                top = cell == PARTICLE_STEAM ? y : top;
+            }
+        }
+        printf("gas %s: %d steam %d smoke, highest steam at row %d, %.3f ms/tick\n", pass == 0 ? "vents" : "dense",
+            counts[PARTICLE_STEAM], counts[PARTICLE_SMOKE], top, per_tick);
+    }
+}
+
+// one cell per pixel, a dry desert, then a beach of sand and dirt along a lake
+static void bench_moisture(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    for (int pass = 0; pass < 2; pass++) {
+        make_grid(grid, 1);
+        const int w = grid->width, h = grid->height;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                particle_t particle = y >= h * 3 / 4 ? (x < w / 2 ? PARTICLE_SAND : PARTICLE_DIRT) : PARTICLE_AIR;
+                if (pass == 1 && y >= h * 3 / 4 && x >= w / 3 && x < w * 2 / 3 && y < h - 32)
+                    particle = PARTICLE_WATER;
+                set_cell(grid, grid_index(grid, x, y), particle);
+            }
+        }
+        if (!moisture_init(grid))
+            return;
+
+        double start = time_now_ms();
+        double update_ms = 0.0;
+        for (int i = 0; i < options.frames; i++) {
+            moisture_step(grid);
+            update_ms += (i + 1) % MOISTURE_INTERVAL == 0 ? moisture_stats().update_ms : 0.0;
+        }
+        double per_tick = (time_now_ms() - start) / options.frames;
+        int counts[PARTICLE_MAX] = { 0 };
+        for (int i = 0; i < grid->count; i++) {
+            counts[grid->data[i]]++;
+        }
+        printf("moisture %s: %d active chunks, %d wet sand %d mud, %.3f ms/tick, %.3f ms/update\n", pass == 0 ? "desert" : "lake",
+            moisture_stats().active_chunks, counts[PARTICLE_WET_SAND], counts[PARTICLE_MUD], per_tick,
+            update_ms / (options.frames / MOISTURE_INTERVAL ? options.frames / MOISTURE_INTERVAL : 1));
+    }
+}
+
+// one cell per pixel: a wood and glass city over sand dunes and a lake
+static void make_city(grid_t* grid)
+{
+    make_grid(grid, 1);
+    const int w = grid->width, h = grid->height;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            particle_t particle = PARTICLE_AIR;
+            if (y >= h / 2 && (x / 64) % 2 == 0)
+                particle = (x / 64) % 4 == 0 ? PARTICLE_WOOD : PARTICLE_GLASS;
+            else if (y >= h * 3 / 4)
+                particle = x < w / 2 ? PARTICLE_SAND : PARTICLE_WATER;
+            set_cell(grid, grid_index(grid, x, y), particle);
+        }
+    }
+}
+
+static void bench_update(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    make_city(grid);
+    fixed_update(); // warm up
+
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        fixed_update();
+    }
+    printf("fixed_update: %dx%d cells, %.3f ms/tick\n", grid->width, grid->height, (time_now_ms() - start) / options.frames);
+}
+
+// the city, fixed_update sweeping every cell and only the awake ones, then
+// for every run of 64 cells whether anything under it is empty, per cell and
+// per word
+static void bench_occupancy(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    for (int pass = 0; pass < 2; pass++) {
+        make_city(grid);
+        occupancy_shutdown();
+        if (pass == 1 && !occupancy_init(grid))
+            return;
+        fixed_update(); // warm up
+        const int64_t repacked = occupancy_stats().repacked;
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            fixed_update();
+        }
+        printf("fixed_update %s: %.3f ms/tick", pass == 0 ? "per cell" : "awake cells", (time_now_ms() - start) / options.frames);
+        if (pass == 1) {
+            printf(", %.0f words repacked/tick", (double)(occupancy_stats().repacked - repacked) / options.frames);
+        }
+        printf("\n");
+    }
+
+    int awake = 0;
+    for (int y = 0; y < grid->height; y++) {
+        const uint32_t* row = occupancy_awake_row(grid, y);
+        for (int x = 0; x < grid->width; x++) {
+            awake += test_bit(row, x);
+        }
+    }
+    double start = time_now_ms();
+    for (int i = 0; i < options.frames; i++) {
+        memset(grid->touched, 1, sizeof(grid->touched));
+        occupancy_refresh(grid, 0, grid->height);
+    }
+    printf("occupancy_refresh whole grid: %.3f ms, %d empty %d awake\n", (time_now_ms() - start) / options.frames,
+        occupancy_count(OCCUPANCY_EMPTY), awake);
+
+    for (int pass = 0; pass < 2; pass++) {
+        int hits = 0;
+        start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            for (int y = 0; y + 1 < grid->height; y++) {
+                for (int x = 0; x < grid->width; x += 64) {
+                    bool any = false;
+                    if (pass == 1) {
+                        any = occupancy_any(OCCUPANCY_EMPTY, y + 1, x, x + 64);
+                    } else {
+                        for (int k = x; k < x + 64 && k < grid->width && !any; k++) {
+                            any = is_empty(k, y + 1);
+                        }
+                    }
+                    hits += any;
+                }
+            }
+        }
+        printf("empty below 64 cells %s: %d hits, %.3f ms/grid\n", pass == 0 ? "is_empty" : "occupancy_any",
+            hits / options.frames, (time_now_ms() - start) / options.frames);
+    }
+}
+
+static int count_cells(const grid_t* grid, particle_t particle)
+{
+    int count = 0;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            count += grid->data[grid_index(grid, x, y)] == (int)particle;
+        }
+    }
+    return count;
+}
+
+// every pass of an engine comparison starts from the same random streams
+static void seed_engines(void)
+{
+    srand(options.seed);
+    game_seed(options.seed);
+    sandboard_seed(options.seed);
+    margolus_seed(options.seed);
+}
+
+// one cell per pixel, a sky full of loose sand settling onto the floor, per
+// cell kernels against the bitboard engine
+static void bench_sandboard(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    for (int pass = 0; pass < 2; pass++) {
+        make_grid(grid, 1);
+        seed_engines();
+        for (int y = 0; y < grid->height; y++) {
+            for (int x = 0; x < grid->width; x++) {
+                set_cell(grid, grid_index(grid, x, y), y >= grid->height / 4 && rand() % 100 < 40 ? PARTICLE_SAND : PARTICLE_AIR);
+            }
+        }
+        sandboard_set_enabled(pass == 1);
+        const int placed = count_cells(grid, PARTICLE_SAND);
+        int chunks = 0;
+        double start = time_now_ms();
+        for (int i = 0; i < options.frames; i++) {
+            fixed_update();
+            chunks += sandboard_stats().chunks;
+        }
+        double per_tick = (time_now_ms() - start) / options.frames;
+        int sand = 0, top = grid->height;
+        for (int y = grid->height - 1; y >= 0; y--) {
+            for (int x = 0; x < grid->width; x++) {
+                const bool is_sand = grid->data[grid_index(grid, x, y)] == PARTICLE_SAND;
+                sand += is_sand;
+                top = is_sand ? y : top;
+            }
+        }
+        printf("sand %s: %d cells, top at row %d, %.1f chunks/tick, %.3f ms/tick, %.2f G cell updates/s\n",
+            pass == 0 ? "per cell" : "bitboard", sand, top, (double)chunks / options.frames, per_tick,
+            (double)grid->width * grid->height / (per_tick * 1e6));
+        if (sand != placed) {
+            printf("sand %s: %d cells placed, %d left\n", pass == 0 ? "per cell" : "bitboard", placed, sand);
+            bench_failed = true;
+        }
+    }
+    sandboard_set_enabled(true);
+}
+
+// fixed_update with each engine, on the city and on a sky of loose sand and
+// water settling at one cell per pixel
+static void bench_margolus(framebuffer_t* fb)
+{
+    (void)fb;
+    grid_t* grid = &game_state.grid;
+    printf("margolus: %d workers\n", parallel_worker_count());
+    for (int scene = 0; scene < 2; scene++) {
+        for (int engine = 0; engine < ENGINE_MAX; engine++) {
+            make_city(grid);
+            seed_engines();
+            if (scene == 1) {
+                for (int y = 0; y < grid->height; y++) {
+                    for (int x = 0; x < grid->width; x++) {
+                        const int roll = rand() % 100;
+                        particle_t particle = roll < 30 ? PARTICLE_SAND : roll < 45 ? PARTICLE_WATER : PARTICLE_AIR;
+                        set_cell(grid, grid_index(grid, x, y), y >= grid->height / 4 ? particle : PARTICLE_AIR);
+                    }
+                }
+            }
+            game_state.engine = engine;
+            const int placed = count_cells(grid, PARTICLE_SAND);
+            fixed_update(); // warm up, builds the block table
+            double start = time_now_ms();
+            for (int i = 0; i < options.frames; i++) {
+                fixed_update();
+            }
+            double per_tick = (time_now_ms() - start) / options.frames;
+            int sand = 0, top = grid->height;
+            for (int y = grid->height - 1; y >= 0; y--) {
+                for (int x = 0; x < grid->width; x++) {
+                    const bool is_sand = grid->data[grid_index(grid, x, y)] == PARTICLE_SAND;
+                    sand += is_sand;
+                    top = is_sand ? y : top;
+                }
+            }
+            printf("%-5s %-16s %d sand, top at row %d, %.3f ms/tick, %.2f G cell updates/s\n", scene == 0 ? "city" : "sky",
+                engine_get_name(engine), sand, top, per_tick, (double)grid->width * grid->height / (per_tick * 1e6));
+            if (sand != placed) {
+                printf("%-5s %-16s %d sand placed, %d left\n", scene == 0 ? "city" : "sky", engine_get_name(engine), placed, sand);
+                bench_failed = true;
+            }
+        }
+    }
+    game_state.engine = options.engine;
+}
+
+// the city again, every pass of a tick timed on its own plus a plain four
+// neighbor stencil; build once as is and once with SIM_GRID_TILED to compare
+static void bench_layout(framebuffer_t* fb)
+{
+    grid_t* grid = &game_state.grid;
+    make_city(grid);
+    if (!heat_init(grid) || !rigid_init(grid) || !gas_init(grid) || !moisture_init(grid))
+        return;
+#if defined(GRID_TILED)
+    printf("layout: %dx%d tiles\n", GRID_TILE, GRID_TILE);
+#else
+    printf("layout: row major\n");
+#endif
+
+    enum { PASS_UPDATE, PASS_RIGID, PASS_FIRE, PASS_GAS, PASS_REACT, PASS_MOISTURE, PASS_HEAT, PASS_RASTER, PASS_STENCIL, PASS_MAX };
+    static const char* names[PASS_MAX] = { "fixed_update", "rigid", "fire", "gas", "react", "moisture", "heat", "raster", "stencil" };
+    double ms[PASS_MAX] = { 0 };
+    long sum = 0;
+    for (int i = 0; i < options.frames; i++) {
+        for (int pass = 0; pass < PASS_MAX; pass++) {
+            double start = time_now_ms();
+            switch (pass) {
+            case PASS_UPDATE:
+                fixed_update();
+                break;
+            case PASS_RIGID:
+                rigid_step(grid);
+                break;
+            case PASS_FIRE:
+                fire_step(grid);
+                break;
+            case PASS_GAS:
+                gas_step(grid);
+                break;
+            case PASS_REACT:
+                react_step(grid);
+                break;
+            case PASS_MOISTURE:
+                moisture_step(grid);
+                break;
+            case PASS_HEAT:
+                heat_step(grid);
+                break;
+            case PASS_RASTER:
+                raster_grid(fb, grid);
+                break;
+            case PASS_STENCIL:
+                for (int y = 1; y + 1 < grid->height; y++) {
+                    for (int x = 1; x + 1 < grid->width; x++) {
+                        sum += grid->data[grid_index(grid, x, y - 1)] + grid->data[grid_index(grid, x, y + 1)]
+                            + grid->data[grid_index(grid, x - 1, y)] + grid->data[grid_index(grid, x + 1, y)];
+                    }
+                }
+                break;
+            }
+            ms[pass] += time_now_ms() - start;
+        }
+    }
+    double total = 0.0;
+    for (int pass = 0; pass < PASS_MAX; pass++) {
+        printf("  %-13s %.3f ms\n", names[pass], ms[pass] / options.frames);
+        total += pass == PASS_STENCIL ? 0.0 : ms[pass];
+    }
+    printf("  tick + raster %.3f ms (stencil sum %ld)\n", total / options.frames, sum);
+}
+
+static int run_bench(framebuffer_t* fb)
+{
+    static const struct {
+        const char* name;
+        void (*func)(framebuffer_t* fb);
+    } benches[] = {
+        { "raster", bench_raster },
+        { "update", bench_update },
+        { "brush", bench_brush },
+        { "fill", bench_fill },
+        { "lod", bench_lod },
+        { "heat", bench_heat },
+        { "fire", bench_fire },
+        { "react", bench_react },
+        { "liquid", bench_liquid },
+        { "rigid", bench_rigid },
+        { "gas", bench_gas },
+        { "moisture", bench_moisture },
+        { "layout", bench_layout },
+        { "occupancy", bench_occupancy },
+        { "sandboard", bench_sandboard },
+        { "margolus", bench_margolus },
+    };
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (strcmp(options.bench, benches[i].name) == 0) {
+            benches[i].func(fb);
+            return bench_failed ? 1 : 0;
+        }
+    }
+    fprintf(stderr, "Unknown bench: %s\n", options.bench);
+    return 1;
+}
+
+static int run_capture(framebuffer_t* fb)
+{
+    char path[4096];
+    for (int frame = 0; frame < options.frames; frame++) {
+        for (int i = 0; i < options.ticks_per_frame; i++) {
+            scene_tick();
+        }
+        if (options.format == FORMAT_NONE)
+            continue;
+
+        raster_grid(fb, &game_state.grid);
+        bool png = options.format == FORMAT_PNG;
+        snprintf(path, sizeof(path), "%s/frame_%05d.%s", options.out_dir, frame, png ? "png" : "ppm");
+        if (!(png ? write_png(fb, path) : write_ppm(fb, path))) {
+            fprintf(stderr, "Failed to write %s\n", path);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (!parse_args(argc, argv))
+        return 1;
+    if (options.frames < 1 || options.ticks_per_frame < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    srand(options.seed);
+    game_seed(options.seed);
+    brush_seed(options.seed);
+    fire_seed(options.seed);
+    gas_seed(options.seed);
+    sandboard_seed(options.seed);
+    margolus_seed(options.seed);
+    react_seed(options.seed);
+    setup_game();
+    game_state.engine = options.engine;
+    scene_setup();
+    if (!sim_init(&game_state.grid))
+        return 1;
+    parallel_init(options.threads);
+
+    framebuffer_t fb;
+    if (!make_framebuffer(&fb, game_state.grid.width * game_state.grid.tile_size, game_state.grid.height * game_state.grid.tile_size)) {
+        fprintf(stderr, "Failed to allocate framebuffer\n");
+        parallel_shutdown();
+        return 1;
+    }
+
+    if ((options.record.path && !record_start(&options.record, &game_state.grid))
+        || (options.share && !share_start(options.share, &game_state.grid))
+        || (options.metrics.path && !metrics_start(&options.metrics))) {
+        record_stop();
+        share_stop();
+        destroy_framebuffer(&fb);
+        parallel_shutdown();
+        return 1;
+    }
+
+    int result = options.bench ? run_bench(&fb) : run_capture(&fb);
+
+    if (record_active()) {
+        record_stop();
+        record_stats_t stats = record_stats();
+        printf("recorded %" PRIu64 " frames (%" PRIu64 " dropped), %.2f MB\n",
+            stats.written, stats.dropped, stats.bytes / (1024.0 * 1024.0));
+    }
+    if (metrics_active()) {
+        metrics_stop();
+        metrics_stats_t stats = metrics_stats();
+        printf("wrote %" PRIu64 " metrics lines (%" PRIu64 " dropped)\n", stats.written, stats.dropped);
+    }
+    share_stop();
+    destroy_framebuffer(&fb);
+    parallel_shutdown();
+    sim_shutdown();
+    plugin_shutdown();
+    return result;
+}
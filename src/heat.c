@@ -0,0 +1,416 @@
+#include "heat.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// fraction of the gap to the neighbor average closed per tick, at most 1 - HEAT_LOSS
+static const float conductivity[PARTICLE_MAX] = {
+    [PARTICLE_AIR] = 0.15f,
+    [PARTICLE_SAND] = 0.3f,
+    [PARTICLE_WOOD] = 0.08f,
+    [PARTICLE_WATER] = 0.6f,
+    [PARTICLE_STEAM] = 0.2f,
+    [PARTICLE_GLASS] = 0.5f,
+    [PARTICLE_FIRE] = 0.3f,
+    [PARTICLE_SMOKE] = 0.15f,
+    [PARTICLE_DIRT] = 0.2f,
+    [PARTICLE_WET_SAND] = 0.45f,
+    [PARTICLE_MUD] = 0.45f,
+};
+
+typedef struct {
+    particle_t to; // PARTICLE_NONE: no transition
+    bool rising; // happens above `at` instead of below
+    float at;
+    float latent; // degrees taken from (rising) or given to the block per cell
+} transition_t;
+
+static const transition_t transitions[PARTICLE_MAX] = {
+    [PARTICLE_WATER] = { PARTICLE_STEAM, true, 100.0f, 5.0f },
+    [PARTICLE_STEAM] = { PARTICLE_WATER, false, 80.0f, 5.0f },
+    [PARTICLE_SAND] = { PARTICLE_GLASS, true, 1700.0f, 50.0f },
+    [PARTICLE_WOOD] = { PARTICLE_FIRE, true, 300.0f, 0.0f },
+    [PARTICLE_WET_SAND] = { PARTICLE_SAND, true, 100.0f, 5.0f },
+    [PARTICLE_MUD] = { PARTICLE_DIRT, true, 100.0f, 5.0f },
+};
+
+_Static_assert(PARTICLE_MAX <= 32, "heat tracks materials present in a chunk as 32 bits");
+
+static struct {
+    float* temp;
+    float* next;
+    float* conduct; // per block, refreshed every few ticks
+    uint32_t* present; // per chunk, bit per material seen at the last refresh
+    uint8_t* active; // per chunk, holds heat
+    uint8_t* awake; // per chunk, active or next to an active chunk
+    uint8_t* was_awake; // awake on the previous tick
+    int width, height; // in blocks
+    int chunks_x, chunks_y;
+    int active_count;
+    unsigned tick;
+    heat_stats_t stats;
+} heat;
+
+bool heat_init(const grid_t* grid)
+{
+    heat_shutdown();
+    heat.width = (grid->width + HEAT_BLOCK - 1) / HEAT_BLOCK;
+    heat.height = (grid->height + HEAT_BLOCK - 1) / HEAT_BLOCK;
+    heat.chunks_x = (heat.width + HEAT_CHUNK - 1) / HEAT_CHUNK;
+    heat.chunks_y = (heat.height + HEAT_CHUNK - 1) / HEAT_CHUNK;
+    const size_t blocks = (size_t)heat.width * heat.height;
+    const size_t chunks = (size_t)heat.chunks_x * heat.chunks_y;
+    heat.temp = malloc(sizeof(float) * blocks);
+    heat.next = malloc(sizeof(float) * blocks);
+    heat.conduct = malloc(sizeof(float) * blocks);
+    heat.present = calloc(chunks, sizeof(uint32_t));
+    heat.active = calloc(chunks, 1);
+    heat.awake = calloc(chunks, 1);
+    heat.was_awake = calloc(chunks, 1);
+    if (!heat.temp || !heat.next || !heat.conduct || !heat.present || !heat.active || !heat.awake || !heat.was_awake) {
+        heat_shutdown();
+        return false;
+    }
+    for (size_t i = 0; i < blocks; i++) {
+        heat.temp[i] = HEAT_AMBIENT;
+        heat.next[i] = HEAT_AMBIENT;
+    }
+    return true;
+}
+
+void heat_shutdown(void)
+{
+    free(heat.temp);
+    free(heat.next);
+    free(heat.conduct);
+    free(heat.present);
+    free(heat.active);
+    free(heat.awake);
+    free(heat.was_awake);
+    memset(&heat, 0, sizeof(heat));
+}
+
+heat_stats_t heat_stats(void)
+{
+    heat.stats.active_chunks = heat.active_count;
+    return heat.stats;
+}
+
+// :CHUNKS
+
+typedef struct {
+    int x0, y0, x1, y1; // blocks, half open
+} chunk_rect_t;
+
+static chunk_rect_t chunk_rect(int cx, int cy)
+{
+    chunk_rect_t r = { cx * HEAT_CHUNK, cy * HEAT_CHUNK, (cx + 1) * HEAT_CHUNK, (cy + 1) * HEAT_CHUNK };
+    if (r.x1 > heat.width)
+        r.x1 = heat.width;
+    if (r.y1 > heat.height)
+        r.y1 = heat.height;
+    return r;
+}
+
+static void wake_chunks(void)
+{
+    uint8_t* swap = heat.was_awake;
+    heat.was_awake = heat.awake;
+    heat.awake = swap;
+    memset(heat.awake, 0, (size_t)heat.chunks_x * heat.chunks_y);
+    for (int cy = 0; cy < heat.chunks_y; cy++) {
+        for (int cx = 0; cx < heat.chunks_x; cx++) {
+            if (!heat.active[cx + cy * heat.chunks_x])
+                continue;
+            for (int y = cy - 1; y <= cy + 1; y++) {
+                for (int x = cx - 1; x <= cx + 1; x++) {
+                    if (x >= 0 && y >= 0 && x < heat.chunks_x && y < heat.chunks_y)
+                        heat.awake[x + y * heat.chunks_x] = 1;
+                }
+            }
+        }
+    }
+}
+
+static uint32_t refresh_conductivity(const grid_t* grid, chunk_rect_t r)
+{
+    uint32_t present = 0;
+    for (int by = r.y0; by < r.y1; by++) {
+        const int y0 = by * HEAT_BLOCK;
+        const int y1 = y0 + 1 < grid->height ? y0 + 1 : y0;
+        float* out = heat.conduct + by * heat.width;
+        for (int bx = r.x0; bx < r.x1; bx++) {
+            const int x0 = bx * HEAT_BLOCK;
+            const int x1 = x0 + 1 < grid->width ? x0 + 1 : x0;
+            const int a = grid->data[grid_index(grid, x0, y0)], b = grid->data[grid_index(grid, x1, y0)];
+            const int c = grid->data[grid_index(grid, x0, y1)], d = grid->data[grid_index(grid, x1, y1)];
+            out[bx] = 0.25f * (conductivity[a] + conductivity[b] + conductivity[c] + conductivity[d]);
+            present |= 1u << a | 1u << b | 1u << c | 1u << d;
+        }
+    }
+    return present;
+}
+
+// :DIFFUSION
+
+static inline float relax(float t, float l, float r, float u, float d, float c)
+{
+    float n = t + c * ((l + r + u + d) * 0.25f - t);
+    return n - HEAT_LOSS * (n - HEAT_AMBIENT);
+}
+
+// world edges are insulated: a missing neighbor is the block itself
+static void diffuse_row(int by, int x0, int x1)
+{
+    const int w = heat.width;
+    const float* row = heat.temp + by * w;
+    const float* up = by > 0 ? row - w : row;
+    const float* down = by + 1 < heat.height ? row + w : row;
+    const float* c = heat.conduct + by * w;
+    float* out = heat.next + by * w;
+
+    int x = x0;
+    if (x == 0) {
+        out[0] = relax(row[0], row[0], row[w > 1 ? 1 : 0], up[0], down[0], c[0]);
+        x++;
+    }
+    const int end = x1 == w ? w - 1 : x1;
+#if defined(__SSE2__)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 ambient = _mm_set1_ps(HEAT_AMBIENT);
+    const __m128 loss = _mm_set1_ps(HEAT_LOSS);
+    for (; x + 4 <= end; x += 4) {
+        __m128 t = _mm_loadu_ps(row + x);
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)),
+            _mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+        __m128 n = _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(c + x), _mm_sub_ps(_mm_mul_ps(sum, quarter), t)));
+        n = _mm_sub_ps(n, _mm_mul_ps(loss, _mm_sub_ps(n, ambient)));
+        _mm_storeu_ps(out + x, n);
+    }
+#endif
+    for (; x < end; x++) {
+        out[x] = relax(row[x], row[x - 1], row[x + 1], up[x], down[x], c[x]);
+    }
+    if (x < x1) {
+        out[x] = relax(row[x], row[x - 1], row[x], up[x], down[x], c[x]);
+    }
+}
+
+// lowest and highest new temperature in the chunk
+static void chunk_range(chunk_rect_t r, float* lo, float* hi)
+{
+    float min = HEAT_MAX, max = -HEAT_MAX;
+    for (int by = r.y0; by < r.y1; by++) {
+        const float* row = heat.next + by * heat.width;
+        int bx = r.x0;
+#if defined(__SSE2__)
+        __m128 vmin = _mm_set1_ps(min), vmax = _mm_set1_ps(max);
+        for (; bx + 4 <= r.x1; bx += 4) {
+            __m128 v = _mm_loadu_ps(row + bx);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+        }
+        float lanes[8];
+        _mm_storeu_ps(lanes, vmin);
+        _mm_storeu_ps(lanes + 4, vmax);
+        for (int i = 0; i < 4; i++) {
+            min = lanes[i] < min ? lanes[i] : min;
+            max = lanes[i + 4] > max ? lanes[i + 4] : max;
+        }
+#endif
+        for (; bx < r.x1; bx++) {
+            min = row[bx] < min ? row[bx] : min;
+            max = row[bx] > max ? row[bx] : max;
+        }
+    }
+    *lo = min;
+    *hi = max;
+}
+
+static void chunk_reset(chunk_rect_t r)
+{
+    for (int by = r.y0; by < r.y1; by++) {
+        for (int bx = r.x0; bx < r.x1; bx++) {
+            heat.temp[bx + by * heat.width] = HEAT_AMBIENT;
+            heat.next[bx + by * heat.width] = HEAT_AMBIENT;
+        }
+    }
+}
+
+// :TRANSITIONS
+
+// a transition can only happen in a chunk whose temperature range crosses it
+static bool transition_possible(const transition_t* tr, float lo, float hi)
+{
+    return tr->to != PARTICLE_NONE && (tr->rising ? hi > tr->at : lo < tr->at);
+}
+
+// the new material starts without the old one's life and moisture: water
+// condensed from steam boils into steam with a fresh lifetime, glass and
+// dried sand or dirt hold no water
+static void transition_cell(grid_t* grid, int i, float* t, const transition_t* tr)
+{
+    if (tr->rising ? *t > tr->at : *t < tr->at) {
+        set_cell(grid, i, tr->to);
+        *t += tr->rising ? -tr->latent : tr->latent;
+    }
+}
+
+// `count` cells stored from `at`, starting at column x0; `temp` is the row of blocks
+static void transition_span(grid_t* grid, int at, float* temp, int x0, int count, particle_t from, const transition_t* tr)
+{
+    const int* cells = grid->data + at;
+    int i = 0;
+#if defined(__SSE2__)
+    // cells of other materials are rejected four at a time
+    const __m128i match = _mm_set1_epi32(from);
+    for (; i + 4 <= count; i += 4) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(cells + i)), match));
+        for (int lane = 0; mask; lane++, mask >>= 4) {
+            if (mask & 1)
+                transition_cell(grid, at + i + lane, &temp[(x0 + i + lane) / HEAT_BLOCK], tr);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (cells[i] == (int)from)
+            transition_cell(grid, at + i, &temp[(x0 + i) / HEAT_BLOCK], tr);
+    }
+}
+
+// materials that arrived since the last refresh change phase a few ticks late
+static void chunk_transitions(grid_t* grid, chunk_rect_t r, uint32_t present, float lo, float hi)
+{
+    const int y1 = r.y1 * HEAT_BLOCK < grid->height ? r.y1 * HEAT_BLOCK : grid->height;
+    const int x1 = r.x1 * HEAT_BLOCK < grid->width ? r.x1 * HEAT_BLOCK : grid->width;
+    for (int from = 0; from < PARTICLE_MAX; from++) {
+        const transition_t* tr = &transitions[from];
+        if (!(present & 1u << from) || !transition_possible(tr, lo, hi))
+            continue;
+        for (int y = r.y0 * HEAT_BLOCK; y < y1; y++) {
+            float* temp = heat.next + (y / HEAT_BLOCK) * heat.width;
+            for (int x = r.x0 * HEAT_BLOCK; x < x1;) {
+                const int span = grid_span(grid, x) < x1 - x ? grid_span(grid, x) : x1 - x;
+                transition_span(grid, grid_index(grid, x, y), temp, x, span, from, tr);
+                x += span;
+            }
+        }
+    }
+}
+
+void heat_step(grid_t* grid)
+{
+    if (heat.active_count == 0) {
+        heat.stats = (heat_stats_t) { 0 };
+        return;
+    }
+    double start = time_now_ms();
+    wake_chunks();
+
+    for (int cy = 0; cy < heat.chunks_y; cy++) {
+        const uint8_t* awake = heat.awake + cy * heat.chunks_x;
+        for (int cx = 0; cx < heat.chunks_x;) {
+            if (!awake[cx]) {
+                cx++;
+                continue;
+            }
+            // neighboring awake chunks diffuse as one run, long rows vectorize better
+            const int run = cx;
+            for (; cx < heat.chunks_x && awake[cx]; cx++) {
+                const unsigned i = cx + cy * heat.chunks_x;
+                // materials move slowly next to heat, so conductivity is refreshed
+                // when a chunk wakes up and then every few ticks, staggered
+                if (!heat.was_awake[i] || (i + heat.tick) % HEAT_REFRESH_TICKS == 0)
+                    heat.present[i] = refresh_conductivity(grid, chunk_rect(cx, cy));
+            }
+            const chunk_rect_t first = chunk_rect(run, cy), last = chunk_rect(cx - 1, cy);
+            for (int by = first.y0; by < first.y1; by++) {
+                diffuse_row(by, first.x0, last.x1);
+            }
+        }
+    }
+
+    double diffused = time_now_ms();
+    heat.active_count = 0;
+    for (int cy = 0; cy < heat.chunks_y; cy++) {
+        for (int cx = 0; cx < heat.chunks_x; cx++) {
+            const int i = cx + cy * heat.chunks_x;
+            if (!heat.awake[i])
+                continue;
+            chunk_rect_t r = chunk_rect(cx, cy);
+            float lo, hi;
+            chunk_range(r, &lo, &hi);
+            heat.active[i] = lo < HEAT_AMBIENT - HEAT_EPSILON || hi > HEAT_AMBIENT + HEAT_EPSILON;
+            if (heat.active[i]) {
+                chunk_transitions(grid, r, heat.present[i], lo, hi);
+                heat.active_count++;
+            } else {
+                // asleep chunks must read ambient from both planes
+                chunk_reset(r);
+            }
+        }
+    }
+
+    float* swap = heat.temp;
+    heat.temp = heat.next;
+    heat.next = swap;
+    heat.tick++;
+    heat.stats.diffuse_ms = (float)(diffused - start);
+    heat.stats.transition_ms = (float)(time_now_ms() - diffused);
+}
+
+// :EDIT
+
+void heat_add(int xc, int yc, int r, float delta)
+{
+    if (!heat.temp)
+        return;
+    const int bxc = xc / HEAT_BLOCK, byc = yc / HEAT_BLOCK;
+    const int br = r / HEAT_BLOCK;
+    for (int by = byc - br; by <= byc + br; by++) {
+        if (by < 0 || by >= heat.height)
+            continue;
+        for (int bx = bxc - br; bx <= bxc + br; bx++) {
+            if (bx < 0 || bx >= heat.width)
+                continue;
+            const int dx = bx - bxc, dy = by - byc;
+            if (dx * dx + dy * dy > br * br + br)
+                continue;
+            float* t = &heat.temp[bx + by * heat.width];
+            *t = fminf(fmaxf(*t + delta, -HEAT_MAX), HEAT_MAX);
+            uint8_t* active = &heat.active[bx / HEAT_CHUNK + (by / HEAT_CHUNK) * heat.chunks_x];
+            heat.active_count += !*active;
+            *active = 1;
+        }
+    }
+}
+
+void heat_raise(int x, int y, float temperature)
+{
+    const int bx = x / HEAT_BLOCK, by = y / HEAT_BLOCK;
+    if (!heat.temp || x < 0 || y < 0 || bx >= heat.width || by >= heat.height)
+        return;
+    float* t = &heat.temp[bx + by * heat.width];
+    if (*t >= temperature)
+        return;
+    *t = temperature;
+    uint8_t* active = &heat.active[bx / HEAT_CHUNK + (by / HEAT_CHUNK) * heat.chunks_x];
+    heat.active_count += !*active;
+    *active = 1;
+}
+
+float heat_get(int x, int y)
+{
+    const int bx = x / HEAT_BLOCK, by = y / HEAT_BLOCK;
+    if (!heat.temp || x < 0 || y < 0 || bx >= heat.width || by >= heat.height)
+        return HEAT_AMBIENT;
+    return heat.temp[bx + by * heat.width];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :HEAT
+// Temperature in degrees, one value per HEAT_BLOCK x HEAT_BLOCK cells. Each
+// tick every block relaxes towards the average of its four neighbors at a
+// rate given by the conductivity of the materials in it, and slowly loses
+// heat to the ambient temperature. Materials change phase when their block
+// crosses a threshold (water boils, sand melts into glass).
+//
+// The field is split into chunks of HEAT_CHUNK x HEAT_CHUNK blocks. Only
+// chunks holding heat and their neighbors are simulated; a chunk that has
+// cooled back to ambient is snapped to it and goes to sleep, so a world at
+// room temperature costs nothing.
+
+#define HEAT_BLOCK 2 // cells per block side
+#define HEAT_CHUNK 16 // blocks per chunk side
+#define HEAT_REFRESH_TICKS 8 // ticks between conductivity refreshes of an awake chunk
+
+#define HEAT_AMBIENT 20.0f
+#define HEAT_MAX 3000.0f
+#define HEAT_EPSILON 0.5f // closer than this to ambient counts as cold
+#define HEAT_LOSS 0.002f // fraction of the excess lost to the air per tick
+
+bool heat_init(const grid_t* grid);
+void heat_shutdown(void);
+
+void heat_step(grid_t* grid);
+
+// cell coordinates
+void heat_add(int xc, int yc, int r, float delta);
+// raises the block holding (x, y) to at least temperature
+void heat_raise(int x, int y, float temperature);
+float heat_get(int x, int y);
+
+typedef struct {
+    int active_chunks;
+    float diffuse_ms; // last tick
+    float transition_ms;
+} heat_stats_t;
+
+heat_stats_t heat_stats(void);
@@ -0,0 +1,101 @@
+#include "input.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "heat.h"
+
+static struct {
+    command_t commands[COMMAND_QUEUE_SIZE];
+    // producer and consumer indices on separate cache lines
+    alignas(64) atomic_uint head;
+    alignas(64) atomic_uint tail;
+    atomic_uint_least64_t dropped;
+} queue;
+
+bool input_push(command_t command)
+{
+    unsigned head = atomic_load_explicit(&queue.head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue.tail, memory_order_acquire);
+    if (head - tail >= COMMAND_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&queue.dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    queue.commands[head & (COMMAND_QUEUE_SIZE - 1)] = command;
+    atomic_store_explicit(&queue.head, head + 1, memory_order_release);
+    return true;
+}
+
+uint64_t input_dropped(void)
+{
+    return atomic_load_explicit(&queue.dropped, memory_order_relaxed);
+}
+
+// :APPLY
+
+static particle_t pointer_particle(const command_t* command)
+{
+    return command->pointer.erase ? PARTICLE_AIR : game_state.brush.element;
+}
+
+static void apply_command(const command_t* command)
+{
+    switch (command->type) {
+    case COMMAND_STROKE: {
+        const int x0 = command->pointer.x0, y0 = command->pointer.y0;
+        const int x1 = command->pointer.x1, y1 = command->pointer.y1;
+        if (game_state.brush.tool == TOOL_BRUSH)
+            draw_stroke(x0, y0, x1, y1, game_state.brush.radius, pointer_particle(command));
+        if (game_state.brush.tool == TOOL_HEAT) {
+            // right button cools
+            const int tile_size = game_state.grid.tile_size;
+            heat_add(x1 / tile_size, y1 / tile_size, game_state.brush.radius, command->pointer.erase ? -HEAT_TOOL_DELTA : HEAT_TOOL_DELTA);
+        }
+    } break;
+    case COMMAND_PRESS:
+        if (game_state.brush.tool == TOOL_BUCKET)
+            fill_region(command->pointer.x0, command->pointer.y0, pointer_particle(command));
+        break;
+    case COMMAND_RELEASE: {
+        // rectangle and line tools apply on release, from the press position
+        const int x0 = command->pointer.x0, y0 = command->pointer.y0;
+        const int x1 = command->pointer.x1, y1 = command->pointer.y1;
+        if (game_state.brush.tool == TOOL_RECTANGLE)
+            draw_rect(x0, y0, x1, y1, pointer_particle(command));
+        if (game_state.brush.tool == TOOL_LINE)
+            draw_line(x0, y0, x1, y1, game_state.brush.radius, pointer_particle(command));
+    } break;
+    case COMMAND_SELECT_ELEMENT:
+        game_state.brush.element = command->element;
+        break;
+    case COMMAND_SELECT_TOOL:
+        game_state.brush.tool = command->tool;
+        break;
+    case COMMAND_RESIZE_BRUSH:
+        game_state.brush.radius += command->radius_delta;
+        if (game_state.brush.radius < 1)
+            game_state.brush.radius = 1;
+        break;
+    case COMMAND_TOGGLE_RECORDING:
+        if (record_active()) {
+            record_stop();
+        } else {
+            record_start(&command->record, &game_state.grid);
+        }
+        break;
+    case COMMAND_NEXT_ENGINE:
+        game_state.engine = (game_state.engine + 1) % ENGINE_MAX;
+        break;
+    }
+}
+
+int input_apply(void)
+{
+    unsigned tail = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue.head, memory_order_acquire);
+    for (unsigned i = tail; i != head; i++) {
+        apply_command(&queue.commands[i & (COMMAND_QUEUE_SIZE - 1)]);
+    }
+    atomic_store_explicit(&queue.tail, head, memory_order_release);
+    return (int)(head - tail);
+}
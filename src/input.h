@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "record.h"
+
+// :INPUT
+// Everything the UI wants to do to the simulation goes through this queue.
+// event() and update() push commands, and the simulation drains them at tick
+// boundaries with input_apply(). The queue is a lock-free single producer,
+// single consumer ring: pushing never blocks. A full queue drops the command
+// and counts it.
+//
+// Brush state (element, tool, radius) is owned by the simulation. Commands
+// carry only what the UI knows: window coordinates and which button is held.
+
+#define COMMAND_QUEUE_SIZE 1024 // power of two
+
+typedef enum {
+    COMMAND_STROKE, // brush moved from (x0, y0) to (x1, y1) while held
+    COMMAND_PRESS, // button went down at (x0, y0)
+    COMMAND_RELEASE, // button went up at (x1, y1), drag started at (x0, y0)
+    COMMAND_SELECT_ELEMENT,
+    COMMAND_SELECT_TOOL,
+    COMMAND_RESIZE_BRUSH,
+    COMMAND_TOGGLE_RECORDING,
+    COMMAND_NEXT_ENGINE,
+} command_type_t;
+
+typedef struct {
+    command_type_t type;
+    union {
+        struct {
+            int x0, y0, x1, y1;
+            bool erase;
+        } pointer;
+        particle_t element;
+        tool_t tool;
+        int radius_delta;
+        record_desc_t record; // used when starting, path must outlive the command
+    };
+} command_t;
+
+bool input_push(command_t command);
+int input_apply(void);
+uint64_t input_dropped(void);
@@ -0,0 +1,153 @@
+#include "liquid.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runs.h"
+
+typedef struct {
+    int body;
+    int y, x;
+} surface_t;
+
+static struct {
+    uint32_t* water; // one bit per cell, `words` words per row
+    uint32_t* air;
+    int words;
+    int width, height;
+    run_labels_t labels;
+
+    surface_t* surfaces;
+    int surface_count, surface_capacity;
+
+    unsigned tick;
+} liquid;
+
+bool liquid_init(const grid_t* grid)
+{
+    liquid_shutdown();
+    liquid.width = grid->width;
+    liquid.height = grid->height;
+    liquid.words = (grid->width + 31) / 32;
+    liquid.water = calloc((size_t)liquid.words * grid->height, sizeof(uint32_t));
+    liquid.air = calloc((size_t)liquid.words * grid->height, sizeof(uint32_t));
+    if (!liquid.water || !liquid.air || !make_run_labels(&liquid.labels, grid->width, grid->height)) {
+        liquid_shutdown();
+        return false;
+    }
+    return true;
+}
+
+void liquid_shutdown(void)
+{
+    free(liquid.water);
+    free(liquid.air);
+    destroy_run_labels(&liquid.labels);
+    free(liquid.surfaces);
+    memset(&liquid, 0, sizeof(liquid));
+}
+
+// :SURFACE
+
+static bool push_surface(int body, int y, int x)
+{
+    if (liquid.surface_count == liquid.surface_capacity) {
+        int capacity = liquid.surface_capacity ? liquid.surface_capacity * 2 : 4096;
+        surface_t* surfaces = realloc(liquid.surfaces, sizeof(surface_t) * capacity);
+        if (!surfaces)
+            return false;
+        liquid.surfaces = surfaces;
+        liquid.surface_capacity = capacity;
+    }
+    liquid.surfaces[liquid.surface_count++] = (surface_t) { body, y, x };
+    return true;
+}
+
+// water cells of the run with air directly above
+static bool find_surface(int run)
+{
+    const run_t* r = &liquid.labels.runs[run];
+    if (r->y == 0)
+        return true;
+    const uint32_t* above = liquid.air + (r->y - 1) * liquid.words;
+    const int body = run_labels_find(&liquid.labels, run);
+    for (int x = r->x0; x < r->x1; x++) {
+        if (test_bit(above, x)) {
+            if (!push_surface(body, r->y, x))
+                return false;
+        }
+    }
+    return true;
+}
+
+// by body, highest surface first
+static int compare_surface(const void* a, const void* b)
+{
+    const surface_t* sa = a;
+    const surface_t* sb = b;
+    if (sa->body != sb->body)
+        return sa->body < sb->body ? -1 : 1;
+    if (sa->y != sb->y)
+        return sa->y < sb->y ? -1 : 1;
+    return (sa->x > sb->x) - (sa->x < sb->x);
+}
+
+// moves water from the top of the body's surface list to above its bottom
+static int level_body(grid_t* grid, int first, int last)
+{
+    int moved = 0;
+    int hi = first, lo = last;
+    while (hi < lo && moved < LIQUID_MOVES) {
+        const surface_t* top = &liquid.surfaces[hi];
+        const surface_t* bottom = &liquid.surfaces[lo];
+        if (bottom->y - top->y < LIQUID_MIN_DROP)
+            break;
+        set_cell(grid, grid_index(grid, top->x, top->y), PARTICLE_AIR);
+        set_cell(grid, grid_index(grid, bottom->x, bottom->y - 1), PARTICLE_WATER);
+        moved++;
+        hi++;
+        lo--;
+    }
+    return moved;
+}
+
+int liquid_solve(grid_t* grid)
+{
+    if (!liquid.water || grid->width != liquid.width || grid->height != liquid.height)
+        return 0;
+    const particle_t water = PARTICLE_WATER, air = PARTICLE_AIR;
+    pack_bits(grid, &water, 1, liquid.water);
+    pack_bits(grid, &air, 1, liquid.air);
+    if (!run_labels_build(&liquid.labels, liquid.water)) {
+        fprintf(stderr, "Liquid: out of memory, skipping solve\n");
+        return 0;
+    }
+
+    liquid.surface_count = 0;
+    for (int run = 0; run < liquid.labels.count; run++) {
+        if (!find_surface(run)) {
+            fprintf(stderr, "Liquid: out of memory, skipping solve\n");
+            return 0;
+        }
+    }
+    qsort(liquid.surfaces, liquid.surface_count, sizeof(surface_t), compare_surface);
+
+    int moved = 0;
+    for (int first = 0; first < liquid.surface_count;) {
+        int last = first;
+        while (last + 1 < liquid.surface_count && liquid.surfaces[last + 1].body == liquid.surfaces[first].body) {
+            last++;
+        }
+        moved += level_body(grid, first, last);
+        first = last + 1;
+    }
+    return moved;
+}
+
+void liquid_step(grid_t* grid)
+{
+    if (++liquid.tick % LIQUID_INTERVAL == 0)
+        liquid_solve(grid);
+}
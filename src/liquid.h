@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :LIQUID
+// Levels connected bodies of water the way pressure would. Cell by cell
+// flow needs thousands of ticks to even out two connected containers; this
+// solver finds each connected body and moves water from its highest surface
+// cells to the air above its lowest ones, a bounded number of cells per body
+// per solve, so a reservoir settles over a few ticks.
+//
+// Every LIQUID_INTERVAL ticks the grid is packed into one bit per cell,
+// 32 cells to a word. Words without water are skipped, the rest are split
+// into runs and the runs of neighboring rows are joined with union-find.
+
+#define LIQUID_INTERVAL 2 // ticks between solves
+#define LIQUID_MOVES 256 // surface cells moved per body per solve
+#define LIQUID_MIN_DROP 2 // rows between the highest and lowest surface before anything moves
+
+bool liquid_init(const grid_t* grid);
+void liquid_shutdown(void);
+
+// once per tick after fixed_update, solves every LIQUID_INTERVAL calls
+void liquid_step(grid_t* grid);
+// solves now, returns the number of cells moved
+int liquid_solve(grid_t* grid);
@@ -0,0 +1,98 @@
+#include "lod.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+bool make_lod(lod_t* lod, int width, int height)
+{
+    *lod = (lod_t) { 0 };
+    lod->level_count = 1;
+    for (int level = 1; level < LOD_MAX_LEVELS && (width > 1 || height > 1); level++) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        lod_level_t* l = &lod->levels[level];
+        l->width = width;
+        l->height = height;
+        l->cells = malloc(sizeof(int) * width * height);
+        l->row_tick = calloc(height, sizeof(uint64_t));
+        if (!l->cells || !l->row_tick) {
+            destroy_lod(lod);
+            return false;
+        }
+        lod->level_count++;
+    }
+    return true;
+}
+
+void destroy_lod(lod_t* lod)
+{
+    for (int level = 1; level < LOD_MAX_LEVELS; level++) {
+        free(lod->levels[level].cells);
+        free(lod->levels[level].row_tick);
+    }
+    *lod = (lod_t) { 0 };
+}
+
+// most common of four, ties go to the first value seen
+static inline int majority4(int a, int b, int c, int d)
+{
+    if (a == b || a == c || a == d)
+        return a;
+    if (b == c || b == d)
+        return b;
+    if (c == d)
+        return c;
+    return a;
+}
+
+static void downsample_row(lod_level_t* dst, const lod_plane_t* src, int y)
+{
+    const int* top = src->cells + (2 * y) * src->width;
+    // odd heights repeat the last row, odd widths the last column
+    const int* bottom = 2 * y + 1 < src->height ? top + src->width : top;
+    int* out = dst->cells + y * dst->width;
+    const int pairs = src->width / 2;
+    for (int x = 0; x < pairs; x++) {
+        out[x] = majority4(top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1]);
+    }
+    if (pairs < dst->width)
+        out[pairs] = majority4(top[2 * pairs], top[2 * pairs], bottom[2 * pairs], bottom[2 * pairs]);
+}
+
+void lod_update(lod_t* lod, const lod_plane_t* source, uint64_t tick)
+{
+    if (lod->built && tick == lod->tick)
+        return;
+    lod_plane_t src = *source;
+    for (int level = 1; level < lod->level_count; level++) {
+        lod_level_t* dst = &lod->levels[level];
+        for (int y = 0; y < dst->height; y++) {
+            uint64_t changed = src.row_tick[2 * y];
+            if (2 * y + 1 < src.height && src.row_tick[2 * y + 1] > changed)
+                changed = src.row_tick[2 * y + 1];
+            if (lod->built && changed <= lod->tick)
+                continue;
+            downsample_row(dst, &src, y);
+            dst->row_tick[y] = changed;
+        }
+        src = (lod_plane_t) { dst->cells, dst->row_tick, dst->width, dst->height };
+    }
+    lod->tick = tick;
+    lod->built = true;
+}
+
+lod_plane_t lod_get_level(const lod_t* lod, const lod_plane_t* source, int level)
+{
+    if (level <= 0)
+        return *source;
+    const lod_level_t* l = &lod->levels[level < lod->level_count ? level : lod->level_count - 1];
+    return (lod_plane_t) { l->cells, l->row_tick, l->width, l->height };
+}
+
+int lod_pick_level(const lod_t* lod, float cells_per_pixel)
+{
+    if (cells_per_pixel <= 1.0f)
+        return 0;
+    int level = (int)floorf(log2f(cells_per_pixel));
+    return level < lod->level_count ? level : lod->level_count - 1;
+}
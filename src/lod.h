@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// :LOD
+// Downsampled pyramid of the material plane for drawing zoomed out views.
+// Level n holds one cell per 2^n x 2^n block of the grid, set to the most
+// common material in its 2x2 parent block. Levels are updated incrementally:
+// only rows whose source rows changed since the last update are rebuilt.
+// Level 0 is the source plane itself and is not stored.
+
+#define LOD_MAX_LEVELS 8
+
+typedef struct {
+    const int* cells;
+    const uint64_t* row_tick; // tick at which each row last changed
+    int width;
+    int height;
+} lod_plane_t;
+
+typedef struct {
+    int* cells;
+    uint64_t* row_tick;
+    int width;
+    int height;
+} lod_level_t;
+
+typedef struct {
+    lod_level_t levels[LOD_MAX_LEVELS]; // [0] unused, level 0 is the source
+    int level_count;
+    uint64_t tick; // source tick the pyramid was last brought up to
+    bool built;
+} lod_t;
+
+bool make_lod(lod_t* lod, int width, int height);
+void destroy_lod(lod_t* lod);
+
+void lod_update(lod_t* lod, const lod_plane_t* source, uint64_t tick);
+// level 0 returns the source
+lod_plane_t lod_get_level(const lod_t* lod, const lod_plane_t* source, int level);
+// coarsest level that still has at least one cell per screen pixel
+int lod_pick_level(const lod_t* lod, float cells_per_pixel);
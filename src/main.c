@@ -1,7 +1,9 @@
 #include <stdio.h>
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <sokol_app.h>
@@ -17,220 +19,32 @@
 
 #include <shaders/grid.h>
 
+#include "camera.h"
+#include "game.h"
+#include "input.h"
+#include "lod.h"
+#include "metrics.h"
+#include "plugin.h"
+#include "record.h"
+#include "share.h"
+#include "sim.h"
+#include "snapshot.h"
+
 // :Application Settings
 
 #define APPLICATION_NAME "Simulation"
-#define WIDTH 1600
-#define HEIGHT 1000
 #define VSYNC true
 #define CLEAR_COLOR 0.11f, 0.11f, 0.11f, 1.0f
 
-#define TILE_SIZE 4
-#define DEFAULT_BRUSH_RADIUS 3
-
-#define DELTA_TIME sapp_frame_duration()
-
-void debug_ui(void);
-
-// :GAME
-
-#define MAX_GRID_COUNT (1920 * 1080)
-typedef struct {
-    int data[MAX_GRID_COUNT];
-    int count;
-    int width;
-    int height;
-    int tile_size;
-} grid_t;
-
-// clang-format off
-#define RGBA_TO_ABGR(color) (                  \
-    ((((uint32_t)color) & 0xff000000) >> 24) | \
-    ((((uint32_t)color) & 0x00ff0000) >> 8)  | \
-    ((((uint32_t)color) & 0x0000ff00) << 8)  | \
-    ((((uint32_t)color) & 0x000000ff) << 24))
-// clang-format on
-
-// enum, color
-#define PARTICLE_ENUM             \
-    X(PARTICLE_NONE, 0x00000000)  \
-    X(PARTICLE_AIR, 0x48beffff)   \
-    X(PARTICLE_SAND, 0xf7dba7ff)  \
-    X(PARTICLE_WOOD, 0xa1662fff)  \
-    X(PARTICLE_WATER, 0x1ca3ecff) \
-    X(PARTICLE_MAX, 0x00000000)
-
-// X(PARTICLE_SAND, 0xf6d7b0ff)
-// X(PARTICLE_SAND, 0xe5be9eff)     \
-// X(PARTICLE_AIR, 0x89c2d9ff)
-// X(PARTICLE_AIR, 0x87ceebff)
-
-#define X(enum_item, _) enum_item,
-typedef enum {
-    PARTICLE_ENUM
-} particle_t;
-#undef X
-#define X(enum_item, _) #enum_item,
-const char* particle_get_name(particle_t particle)
-{
-    static const char* names[] = {
-        PARTICLE_ENUM
-    };
-    return names[particle];
-}
-#undef X
-#define X(_, color) RGBA_TO_ABGR(color),
-uint32_t particle_get_color(particle_t e_particle)
-{
-    static uint32_t particle_color[] = {
-        PARTICLE_ENUM
-    };
-    return particle_color[e_particle];
-}
-#undef X
-
-struct game_state_t {
-    grid_t grid;
-    struct {
-        int radius;
-        particle_t element;
-    } brush;
-    struct {
-        enum {
-            MOUSE_NONE,
-            MOUSE_LEFT,
-            MOUSE_RIGHT,
-        } held;
-        struct {
-            float x, y;
-        } pos;
-        struct {
-            float x, y;
-        } scroll;
-    } mouse_info;
-} game_state;
-
-void make_grid(grid_t* grid, int tile_size)
-{
-    grid->width = WIDTH / tile_size;
-    grid->height = HEIGHT / tile_size;
-    grid->count = grid->width * grid->height;
-    grid->tile_size = tile_size;
-    assert(grid->count <= MAX_GRID_COUNT && "MAX_GRID_COUNT exceeded");
-    memset(grid->data, PARTICLE_NONE, sizeof(grid->data[0]) * MAX_GRID_COUNT);
-}
-
-void setup_game(void)
-{
-    make_grid(&game_state.grid, TILE_SIZE);
-    for (int i = 0; i < game_state.grid.count; i++) {
-        game_state.grid.data[i] = PARTICLE_AIR;
-    }
-    game_state.brush.radius = DEFAULT_BRUSH_RADIUS;
-    game_state.brush.element = PARTICLE_SAND;
-    game_state.mouse_info.held = MOUSE_NONE;
-    game_state.mouse_info.pos.x = 0.0f;
-    game_state.mouse_info.pos.y = 0.0f;
-}
+#define CAMERA_PAN_STEP 64.0f // screen pixels per arrow key press
+#define CAMERA_ZOOM_STEP 1.1f
 
-particle_t get_tile(int x, int y)
-{
-    if (x < 0 || y < 0 || x > game_state.grid.width || y > game_state.grid.height)
-        return PARTICLE_NONE;
-    return game_state.grid.data[x + y * game_state.grid.width];
-}
+#define RECORD_PATH "recording.sdd"
+#define RECORD_EVERY_N 2
 
-void set_tile(int x, int y, particle_t particle)
-{
-    if (x < 0 || y < 0 || x > game_state.grid.width || y > game_state.grid.height)
-        return;
-    game_state.grid.data[x + y * game_state.grid.width] = particle;
-}
-
-void set_tile_safe(int x, int y, particle_t particle)
-{
-    if (get_tile(x, y) == PARTICLE_AIR) {
-        set_tile(x, y, particle);
-    }
-}
-
-void erase_tile(int x, int y)
-{
-    set_tile(x, y, PARTICLE_AIR);
-}
-
-// converts from window to grid
-void set_tile_from_window(int x, int y, particle_t particle)
-{
-    x = x / game_state.grid.tile_size;
-    y = y / game_state.grid.tile_size;
-    set_tile(x, y, particle);
-}
-
-bool is_empty(int x, int y)
-{
-    particle_t tile = get_tile(x, y);
-    return tile == PARTICLE_AIR;
-}
-
-void draw_horizontal_line(int x1, int x2, int y, particle_t particle)
-{
-    for (int x = x1; x <= x2; x++) {
-        if (rand() % 100 < 25) {
-            if (particle == PARTICLE_AIR) {
-                erase_tile(x, y);
-            } else {
-                set_tile_safe(x, y, particle);
-            }
-        }
-    }
-}
-
-// filled circle
-void draw_circle(int xc, int yc, int r, particle_t particle)
-{
-    xc = xc / game_state.grid.tile_size;
-    yc = yc / game_state.grid.tile_size;
-    r--;
-    int x = 0, y = r;
-    int d = 1 - r; // Initial decision parameter
-
-    while (x <= y) {
-        draw_horizontal_line(xc - x, xc + x, yc + y, particle);
-        draw_horizontal_line(xc - x, xc + x, yc - y, particle);
-        draw_horizontal_line(xc - y, xc + y, yc + x, particle);
-        draw_horizontal_line(xc - y, xc + y, yc - x, particle);
-
-        // Midpoint decision
-        if (d < 0) {
-            d += 2 * x + 3;
-        } else {
-            d += 2 * (x - y) + 5;
-            y--;
-        }
-        x++;
-    }
-}
+#define DELTA_TIME sapp_frame_duration()
 
-void update_particle(int x, int y)
-{
-    if (get_tile(x, y) == PARTICLE_SAND) {
-        particle_t below = get_tile(x, y + 1);
-        particle_t left = get_tile(x - 1, y + 1);
-        particle_t right = get_tile(x + 1, y + 1);
-
-        if (is_empty(x, y + 1)) {
-            set_tile(x, y, below);
-            set_tile(x, y + 1, PARTICLE_SAND);
-        } else if (is_empty(x - 1, y + 1)) {
-            set_tile(x, y, left);
-            set_tile(x - 1, y + 1, PARTICLE_SAND);
-        } else if (is_empty(x + 1, y + 1)) {
-            set_tile(x, y, right);
-            set_tile(x + 1, y + 1, PARTICLE_SAND);
-        }
-    }
-}
+void debug_ui(const snapshot_t* snapshot);
 
 // :RENDERING
 
@@ -249,8 +63,12 @@ typedef struct {
     PixelInstance instance_data[MAX_PIXEL_INSTANCE];
 } GridRenderState;
 static GridRenderState grid_render_state;
+static camera_t camera;
+static lod_t lod;
+static const char* share_name; // --share NAME, see share.h
+static const char* metrics_path; // --metrics FILE, see metrics.h
 
-void update_pixels(sg_buffer* buf);
+int update_pixels(sg_buffer* buf, const lod_plane_t* plane, uint64_t tick, int level, const camera_view_t* view);
 
 // void make_grid_pipeline(void)
 void make_grid_pipeline(GridRenderState* pip)
@@ -326,7 +144,9 @@ void render_init(void)
 
 void render(void)
 {
-    debug_ui();
+    // newest completed tick, the simulation keeps running while we draw it
+    const snapshot_t* snapshot = snapshot_acquire();
+    debug_ui(snapshot);
 
     sg_begin_pass(&(sg_pass) {
         .action.colors[0] = {
@@ -336,7 +156,18 @@ void render(void)
         .swapchain = sglue_swapchain(),
     });
 
-    update_pixels(&grid_render_state.instance);
+    // once a cell is smaller than a screen pixel draw a coarser level, so the
+    // instance count is bounded by the screen size and not the world size
+    lod_plane_t plane = { snapshot->cells, snapshot->row_tick, snapshot->width, snapshot->height };
+    int level = lod_pick_level(&lod, 1.0f / (camera.zoom * snapshot->tile_size));
+    if (level > 0) {
+        lod_update(&lod, &plane, snapshot->tick);
+        plane = lod_get_level(&lod, &plane, level);
+    }
+    const float cell_size = snapshot->tile_size * (float)(1 << level);
+
+    camera_view_t view = camera_get_view(&camera, sapp_widthf(), sapp_heightf(), plane.width, plane.height, cell_size);
+    int instance_count = update_pixels(&grid_render_state.instance, &plane, snapshot->tick, level, &view);
 
     sg_apply_pipeline(grid_render_state.pipeline);
     sg_apply_bindings(&(sg_bindings) {
@@ -350,67 +181,129 @@ void render(void)
     } mvp;
 
     glm_mat4_identity(mvp.model);
-    glm_scale(mvp.model, (vec3) { game_state.grid.tile_size, game_state.grid.tile_size, 1.0 });
+    glm_scale(mvp.model, (vec3) { cell_size, cell_size, 1.0 });
 
     glm_mat4_identity(mvp.view);
-    glm_translate(mvp.view, (vec3) { game_state.grid.tile_size / 2.0, game_state.grid.tile_size / 2.0, 0.0 });
+    glm_translate(mvp.view, (vec3) { cell_size / 2.0, cell_size / 2.0, 0.0 });
 
     glm_mat4_identity(mvp.projection);
 
-    glm_ortho(0.0f, WIDTH, HEIGHT, 0.0f, -1.0f, 1.0f, mvp.projection);
+    glm_ortho(view.left, view.right, view.bottom, view.top, -1.0f, 1.0f, mvp.projection);
     sg_apply_uniforms(0, &SG_RANGE(mvp));
 
-    sg_draw(0, 6, game_state.grid.count);
+    if (instance_count > 0)
+        sg_draw(0, 6, instance_count);
     simgui_render();
 
     sg_end_pass();
     sg_commit();
 }
 
-void update_pixels(sg_buffer* buf)
+// fills the instance buffer with the cells of plane inside view only, returns the instance count
+int update_pixels(sg_buffer* buf, const lod_plane_t* plane, uint64_t tick, int level, const camera_view_t* view)
 {
-    for (int i = 0; i < game_state.grid.count; i++) {
-        int x = i % game_state.grid.width;
-        int y = i / game_state.grid.width;
-        grid_render_state.instance_data[i].x = x;
-        grid_render_state.instance_data[i].y = y;
-        assert(game_state.grid.data[i] < PARTICLE_MAX && "Unknown particle in grid");
-        grid_render_state.instance_data[i].color = particle_get_color(game_state.grid.data[i]);
+    // tick, level and view currently in the instance buffer; when only the
+    // tick changed, rows that did not change after drawn_tick are kept
+    static uint64_t drawn_tick = 0;
+    static int drawn_level = 0;
+    static camera_view_t drawn_view;
+    static bool uploaded = false;
+
+    const int x0 = view->cell_x0, x1 = view->cell_x1;
+    const int y0 = view->cell_y0, y1 = view->cell_y1;
+    const int visible_width = x1 - x0;
+    const int count = visible_width * (y1 - y0);
+    bool moved = !uploaded || level != drawn_level
+        || x0 != drawn_view.cell_x0 || x1 != drawn_view.cell_x1
+        || y0 != drawn_view.cell_y0 || y1 != drawn_view.cell_y1;
+    if (count <= 0 || (!moved && tick == drawn_tick))
+        return count;
+
+    for (int y = y0; y < y1; y++) {
+        if (!moved && plane->row_tick[y] <= drawn_tick)
+            continue;
+        PixelInstance* row = grid_render_state.instance_data + (y - y0) * visible_width;
+        const int* cells = plane->cells + y * plane->width;
+        for (int x = x0; x < x1; x++) {
+            row[x - x0].x = x;
+            row[x - x0].y = y;
+            assert(cells[x] < PARTICLE_MAX && "Unknown particle in grid");
+            row[x - x0].color = particle_get_color(cells[x]);
+        }
     }
+    drawn_tick = tick;
+    drawn_level = level;
+    drawn_view = *view;
+    uploaded = true;
 
-    sg_update_buffer(*buf, &SG_RANGE(grid_render_state.instance_data));
+    sg_update_buffer(*buf, &(sg_range) { grid_render_state.instance_data, sizeof(PixelInstance) * count });
+    return count;
 }
 
 // :EVENT
 
+void mouse_world_pos(float* x, float* y)
+{
+    camera_screen_to_world(&camera, sapp_widthf(), sapp_heightf(), game_state.mouse_info.pos.x, game_state.mouse_info.pos.y, x, y);
+}
+
+void push_pointer(command_type_t type, bool erase)
+{
+    float x, y;
+    mouse_world_pos(&x, &y);
+    input_push((command_t) {
+        .type = type,
+        .pointer = {
+            .x0 = game_state.mouse_info.anchor.x,
+            .y0 = game_state.mouse_info.anchor.y,
+            .x1 = x,
+            .y1 = y,
+            .erase = erase,
+        },
+    });
+}
+
 void event_mouseup(const sapp_event* e)
 {
     // LEFT
     if (e->mouse_button == SAPP_MOUSEBUTTON_LEFT) {
+        if (game_state.mouse_info.held == MOUSE_LEFT)
+            push_pointer(COMMAND_RELEASE, false);
         game_state.mouse_info.held = MOUSE_NONE;
     }
     // RIGHT
     if (e->mouse_button == SAPP_MOUSEBUTTON_RIGHT) {
+        if (game_state.mouse_info.held == MOUSE_RIGHT)
+            push_pointer(COMMAND_RELEASE, true);
         game_state.mouse_info.held = MOUSE_NONE;
     }
     // MIDDLE
     if (e->mouse_button == SAPP_MOUSEBUTTON_MIDDLE) {
+        game_state.mouse_info.panning = false;
     }
 }
 
 void event_mousedown(const sapp_event* e)
 {
+    // start a new stroke instead of connecting to where the cursor was before the click
+    mouse_world_pos(&game_state.mouse_info.last.x, &game_state.mouse_info.last.y);
+    game_state.mouse_info.anchor = game_state.mouse_info.last;
+    camera_follow(&camera, game_state.mouse_info.anchor.x, game_state.mouse_info.anchor.y);
     // LEFT
     if (e->mouse_button == SAPP_MOUSEBUTTON_LEFT) {
         game_state.mouse_info.held = MOUSE_LEFT;
+        push_pointer(COMMAND_PRESS, false);
     }
     // RIGHT
     if (e->mouse_button == SAPP_MOUSEBUTTON_RIGHT) {
-        if (game_state.mouse_info.held == MOUSE_NONE)
+        if (game_state.mouse_info.held == MOUSE_NONE) {
             game_state.mouse_info.held = MOUSE_RIGHT;
+            push_pointer(COMMAND_PRESS, true);
+        }
     }
     // MIDDLE
     if (e->mouse_button == SAPP_MOUSEBUTTON_MIDDLE) {
+        game_state.mouse_info.panning = true;
     }
 }
 
@@ -421,13 +314,68 @@ void event_keydown(const sapp_event* e)
         sapp_request_quit();
         break;
     case SAPP_KEYCODE_1:
-        game_state.brush.element = PARTICLE_SAND;
+        input_push((command_t) { .type = COMMAND_SELECT_ELEMENT, .element = PARTICLE_SAND });
         break;
     case SAPP_KEYCODE_2:
-        game_state.brush.element = PARTICLE_WOOD;
+        input_push((command_t) { .type = COMMAND_SELECT_ELEMENT, .element = PARTICLE_WOOD });
         break;
     case SAPP_KEYCODE_3:
-        game_state.brush.element = PARTICLE_WATER;
+        input_push((command_t) { .type = COMMAND_SELECT_ELEMENT, .element = PARTICLE_WATER });
+        break;
+    case SAPP_KEYCODE_4:
+        input_push((command_t) { .type = COMMAND_SELECT_ELEMENT, .element = PARTICLE_FIRE });
+        break;
+    case SAPP_KEYCODE_5:
+        input_push((command_t) { .type = COMMAND_SELECT_ELEMENT, .element = PARTICLE_DIRT });
+        break;
+    case SAPP_KEYCODE_B:
+        input_push((command_t) { .type = COMMAND_SELECT_TOOL, .tool = TOOL_BRUSH });
+        break;
+    case SAPP_KEYCODE_F:
+        input_push((command_t) { .type = COMMAND_SELECT_TOOL, .tool = TOOL_BUCKET });
+        break;
+    case SAPP_KEYCODE_G:
+        input_push((command_t) { .type = COMMAND_SELECT_TOOL, .tool = TOOL_RECTANGLE });
+        break;
+    case SAPP_KEYCODE_L:
+        input_push((command_t) { .type = COMMAND_SELECT_TOOL, .tool = TOOL_LINE });
+        break;
+    case SAPP_KEYCODE_H:
+        input_push((command_t) { .type = COMMAND_SELECT_TOOL, .tool = TOOL_HEAT });
+        break;
+    case SAPP_KEYCODE_LEFT:
+        camera_pan(&camera, CAMERA_PAN_STEP, 0.0f);
+        break;
+    case SAPP_KEYCODE_RIGHT:
+        camera_pan(&camera, -CAMERA_PAN_STEP, 0.0f);
+        break;
+    case SAPP_KEYCODE_UP:
+        camera_pan(&camera, 0.0f, CAMERA_PAN_STEP);
+        break;
+    case SAPP_KEYCODE_DOWN:
+        camera_pan(&camera, 0.0f, -CAMERA_PAN_STEP);
+        break;
+    case SAPP_KEYCODE_HOME:
+        camera_reset(&camera, WIDTH, HEIGHT);
+        break;
+    case SAPP_KEYCODE_C:
+        // follow the last place the brush was pressed
+        camera.follow = !camera.follow;
+        camera_follow(&camera, game_state.mouse_info.anchor.x, game_state.mouse_info.anchor.y);
+        break;
+    case SAPP_KEYCODE_M:
+        input_push((command_t) { .type = COMMAND_NEXT_ENGINE });
+        break;
+    case SAPP_KEYCODE_R:
+        input_push((command_t) {
+            .type = COMMAND_TOGGLE_RECORDING,
+            .record = {
+                .path = RECORD_PATH,
+                .source = RECORD_SOURCE_GRID,
+                .format = RECORD_FORMAT_DELTA,
+                .every_n = RECORD_EVERY_N,
+            },
+        });
         break;
     default:
         break;
@@ -436,6 +384,27 @@ void event_keydown(const sapp_event* e)
 
 // :APPLICATION
 
+// each step says why it failed, share_start(), metrics_start() and
+// sim_start() print that themselves
+static bool start_simulation(void)
+{
+    if (!sim_init(&game_state.grid))
+        return false;
+    if (!make_lod(&lod, game_state.grid.width, game_state.grid.height)) {
+        fprintf(stderr, "Failed to allocate the level of detail planes\n");
+        return false;
+    }
+    if (!snapshot_init(&game_state.grid)) {
+        fprintf(stderr, "Failed to allocate the render snapshots\n");
+        return false;
+    }
+    if (share_name && !share_start(share_name, &game_state.grid))
+        return false;
+    if (metrics_path && !metrics_start(&(metrics_desc_t) { .path = metrics_path }))
+        return false;
+    return sim_start();
+}
+
 void init(void)
 {
     sg_setup(&(sg_desc) {
@@ -444,36 +413,30 @@ void init(void)
     });
     render_init();
     setup_game();
-}
-
-// TODO: move to another thread, to make consistent
-void fixed_update(void)
-{
-    for (int y = game_state.grid.height - 1; y >= 0; y--) {
-        bool left_to_right = rand() % 100 > 50;
-        for (int i = 0; i < game_state.grid.width; i++) {
-            int x = left_to_right ? i : game_state.grid.width - 1 - i;
-            update_particle(x, y);
-        }
-    }
+    camera_reset(&camera, WIDTH, HEIGHT);
+    if (!start_simulation())
+        sapp_quit(); // cleanup() frees whatever was started
 }
 
 void update(void)
 {
-    static const double interval = 20.0;
-    static double current = 0.0;
-    if (current > interval) {
-        fixed_update();
-        current = 0.0;
-    }
-    current += DELTA_TIME * 1000.0;
-    if (game_state.mouse_info.held == MOUSE_LEFT) {
-        draw_circle(game_state.mouse_info.pos.x, game_state.mouse_info.pos.y, game_state.brush.radius, game_state.brush.element);
-    }
-
-    if (game_state.mouse_info.held == MOUSE_RIGHT) {
-        draw_circle(game_state.mouse_info.pos.x, game_state.mouse_info.pos.y, game_state.brush.radius, PARTICLE_AIR);
+    camera_update(&camera, DELTA_TIME);
+    float x, y;
+    mouse_world_pos(&x, &y);
+    if (game_state.mouse_info.held != MOUSE_NONE) {
+        input_push((command_t) {
+            .type = COMMAND_STROKE,
+            .pointer = {
+                .x0 = game_state.mouse_info.last.x,
+                .y0 = game_state.mouse_info.last.y,
+                .x1 = x,
+                .y1 = y,
+                .erase = game_state.mouse_info.held == MOUSE_RIGHT,
+            },
+        });
     }
+    game_state.mouse_info.last.x = x;
+    game_state.mouse_info.last.y = y;
     render();
 }
 
@@ -489,6 +452,8 @@ void event(const sapp_event* e)
     case SAPP_EVENTTYPE_MOUSE_MOVE:
         game_state.mouse_info.pos.x = e->mouse_x;
         game_state.mouse_info.pos.y = e->mouse_y;
+        if (game_state.mouse_info.panning)
+            camera_pan(&camera, e->mouse_dx, e->mouse_dy);
         break;
     case SAPP_EVENTTYPE_MOUSE_ENTER:
         break;
@@ -502,14 +467,17 @@ void event(const sapp_event* e)
         break;
     case SAPP_EVENTTYPE_MOUSE_SCROLL: {
         game_state.mouse_info.scroll.y = e->scroll_y;
+        if (e->modifiers & SAPP_MODIFIER_CTRL) {
+            float factor = powf(CAMERA_ZOOM_STEP, e->scroll_y);
+            camera_zoom_at(&camera, sapp_widthf(), sapp_heightf(), e->mouse_x, e->mouse_y, factor);
+            break;
+        }
         if (game_state.mouse_info.scroll.y > 0.1) {
-            game_state.brush.radius++;
+            input_push((command_t) { .type = COMMAND_RESIZE_BRUSH, .radius_delta = 1 });
         }
         if (game_state.mouse_info.scroll.y < -0.1) {
-            game_state.brush.radius--;
+            input_push((command_t) { .type = COMMAND_RESIZE_BRUSH, .radius_delta = -1 });
         }
-        if (game_state.brush.radius < 1)
-            game_state.brush.radius = 1;
     } break;
     default:
         fprintf(stderr, "Unknown event type: %d\n", e->type);
@@ -518,6 +486,14 @@ void event(const sapp_event* e)
 
 void cleanup(void)
 {
+    sim_stop();
+    record_stop();
+    share_stop();
+    metrics_stop();
+    snapshot_shutdown();
+    sim_shutdown();
+    plugin_shutdown();
+    destroy_lod(&lod);
     simgui_shutdown();
     sg_shutdown();
 }
@@ -526,8 +502,16 @@ void cleanup(void)
 
 sapp_desc sokol_main(int argc, char** argv)
 {
-    (void)argc;
-    (void)argv;
+    // material plugins go in before init() builds anything from the materials
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--plugin") == 0) {
+            plugin_load(argv[++i]);
+        } else if (strcmp(argv[i], "--share") == 0) {
+            share_name = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics_path = argv[++i];
+        }
+    }
     return (sapp_desc) {
         .window_title = APPLICATION_NAME,
         .width = WIDTH,
@@ -543,7 +527,7 @@ sapp_desc sokol_main(int argc, char** argv)
 
 // :DEBUG
 
-void debug_ui(void)
+void debug_ui(const snapshot_t* snapshot)
 {
     simgui_new_frame(&(simgui_frame_desc_t) {
         .width = sapp_width(),
@@ -554,7 +538,9 @@ void debug_ui(void)
     igSetNextWindowPos((ImVec2) { 10, 10 }, ImGuiCond_Once, (ImVec2) { 0, 0 });
     igBegin("Debug", 0, ImGuiWindowFlags_AlwaysAutoResize);
     igText("FPS: %.2lf", (1.0 / DELTA_TIME));
-    igText("Grid (WxH): %dx%d", game_state.grid.width, game_state.grid.height);
+    igText("Grid (WxH): %dx%d", snapshot->width, snapshot->height);
+    igText("Tick: %" PRIu64 " (%.2f ms)", snapshot->tick, snapshot->tick_ms);
+    igText("Engine: %s (M)", engine_get_name(snapshot->engine));
     igText("Mouse:");
     igText(" Pos: (%.2f, %.2f)", game_state.mouse_info.pos.x, game_state.mouse_info.pos.y);
     const char* held = "NONE";
@@ -565,11 +551,30 @@ void debug_ui(void)
     }
     igText(" Held: %s", held);
     igText(" Scroll: %f", game_state.mouse_info.scroll.y);
+    igText(" Dropped commands: %" PRIu64, input_dropped());
+    igSpacing();
+    igSeparator();
+    igSpacing();
+    igText("Camera (arrows, middle drag, ctrl+scroll, Home, C):");
+    igText(" center: (%.1f, %.1f) zoom: %.2f%s", camera.x, camera.y, camera.zoom, camera.follow ? " follow" : "");
+    igText(" lod level: %d", lod_pick_level(&lod, 1.0f / (camera.zoom * snapshot->tile_size)));
     igSpacing();
     igSeparator();
     igSpacing();
     igText("Brush:");
-    igText(" element: %s", particle_get_name(game_state.brush.element));
-    igText(" radius: %d", game_state.brush.radius);
+    igText(" tool: %s (B/F/G/L/H)", tool_get_name(snapshot->brush.tool));
+    igText(" element: %s", particle_get_name(snapshot->brush.element));
+    igText(" radius: %d", snapshot->brush.radius);
+    igSpacing();
+    igSeparator();
+    igSpacing();
+    if (record_active()) {
+        record_stats_t stats = record_stats();
+        igText("Recording (R to stop):");
+        igText(" frames: %" PRIu64 " written, %" PRIu64 " dropped", stats.written, stats.dropped);
+        igText(" size: %.2f MB", stats.bytes / (1024.0 * 1024.0));
+    } else {
+        igText("Recording: off (R to start)");
+    }
     igEnd();
 }
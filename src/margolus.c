@@ -0,0 +1,262 @@
+#include "margolus.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "rng.h"
+#include "thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// a block state holds the materials of its top left, top right, bottom left
+// and bottom right cells as the digits of a base PARTICLE_MAX number
+#define BLOCK_STATES (PARTICLE_MAX * PARTICLE_MAX * PARTICLE_MAX * PARTICLE_MAX)
+#define BLOCK_ROLLS 8
+#define STAY 0xe4 // every cell keeps its place
+
+_Static_assert(WIDTH <= 64 * 64, "moved blocks are kept as a bit per 64 columns");
+
+static struct {
+    bool built;
+    // per roll and state, two bits per cell: which cell of the block moves there
+    uint8_t moves[BLOCK_ROLLS][BLOCK_STATES];
+    rng_t rng;
+    uint64_t step;
+    atomic_int blocks, moved;
+    // per row of blocks, bit x / 64 set when a block at x moved; the workers
+    // each keep their own rows and the grid is flagged after they are done
+    uint64_t moved_columns[HEIGHT / 2 + 2];
+} margolus = { .rng = { 0x853c49e6748fea9bull } };
+
+void margolus_seed(uint64_t seed)
+{
+    margolus.rng = make_rng(seed);
+}
+
+// :TABLE
+
+static bool is_mover(int particle)
+{
+    const movement_t movement = particle_get_movement(particle);
+    return movement == MOVE_POWDER || movement == MOVE_LIQUID;
+}
+
+static int quarters(uint32_t threshold)
+{
+    return (int)((threshold + 8192) >> 14);
+}
+
+static bool sinks(int particle, int other, int roll)
+{
+    return (particle_sinks_through(particle) & 1u << other) && roll < quarters(particle_sink_threshold(particle, other));
+}
+
+typedef struct {
+    int material[4];
+    int from[4];
+    bool moved[4];
+} block_t;
+
+static void move(block_t* block, int a, int b)
+{
+    const int material = block->material[a], from = block->from[a];
+    block->material[a] = block->material[b];
+    block->from[a] = block->from[b];
+    block->material[b] = material;
+    block->from[b] = from;
+    block->moved[a] = block->moved[b] = true;
+}
+
+static uint8_t block_moves(int state, int roll)
+{
+    block_t block = { .from = { 0, 1, 2, 3 } };
+    for (int cell = 0; cell < 4; cell++) {
+        block.material[cell] = state % PARTICLE_MAX;
+        state /= PARTICLE_MAX;
+    }
+    const int first = roll & 1;
+    const int chance = roll >> 1;
+    const int* m = block.material;
+
+    for (int i = 0; i < 2; i++) {
+        const int top = i ^ first;
+        if (is_mover(m[top]) && sinks(m[top], m[top + 2], chance))
+            move(&block, top, top + 2);
+    }
+    for (int i = 0; i < 2; i++) {
+        const int top = i ^ first, diagonal = 3 - top;
+        if (block.moved[top] || block.moved[diagonal] || !is_mover(m[top]))
+            continue;
+        if (particle_get_movement(m[top]) == MOVE_POWDER && chance >= quarters(particle_slide_threshold(m[top])))
+            continue;
+        if (sinks(m[top], m[diagonal], chance))
+            move(&block, top, diagonal);
+    }
+    for (int row = 0; row < 4; row += 2) {
+        const int a = row + first, b = row + 1 - first;
+        if (block.moved[a] || block.moved[b])
+            continue;
+        if (particle_get_movement(m[a]) == MOVE_LIQUID && sinks(m[a], m[b], chance)) {
+            move(&block, a, b);
+        } else if (particle_get_movement(m[b]) == MOVE_LIQUID && sinks(m[b], m[a], chance)) {
+            move(&block, b, a);
+        }
+    }
+    return (uint8_t)(block.from[0] | block.from[1] << 2 | block.from[2] << 4 | block.from[3] << 6);
+}
+
+static void build_moves(void)
+{
+    for (int roll = 0; roll < BLOCK_ROLLS; roll++) {
+        for (int state = 0; state < BLOCK_STATES; state++) {
+            margolus.moves[roll][state] = block_moves(state, roll);
+        }
+    }
+    margolus.built = true;
+}
+
+// :STEP
+
+typedef struct {
+    grid_t* grid;
+    int offset;
+    uint64_t seed;
+} step_job_t;
+
+// whether the 2x2 blocks at (x, y) and (x + 2, y) are each one material
+static bool uniform_pair(const grid_t* grid, int x, int y)
+{
+#if defined(__SSE2__)
+    const __m128i top = _mm_loadu_si128((const __m128i*)(grid->data + grid_index(grid, x, y)));
+    const __m128i bottom = _mm_loadu_si128((const __m128i*)(grid->data + grid_index(grid, x, y + 1)));
+    const __m128i across = _mm_shuffle_epi32(top, _MM_SHUFFLE(2, 3, 0, 1));
+    const __m128i same = _mm_and_si128(_mm_cmpeq_epi32(top, bottom), _mm_cmpeq_epi32(top, across));
+    return _mm_movemask_epi8(same) == 0xffff;
+#else
+    const int* top = grid->data + grid_index(grid, x, y);
+    const int* bottom = grid->data + grid_index(grid, x, y + 1);
+    return top[0] == top[1] && top[2] == top[3] && top[0] == bottom[0] && top[1] == bottom[1]
+        && top[2] == bottom[2] && top[3] == bottom[3];
+#endif
+}
+
+// moves the cells of the block at `at`, -1 for cells outside the grid, which
+// read as PARTICLE_NONE and so never move; returns the cells moved
+static int move_block(grid_t* grid, const int at[4], uint64_t roll)
+{
+    int material[4];
+    for (int cell = 0; cell < 4; cell++) {
+        material[cell] = at[cell] < 0 ? PARTICLE_NONE : grid->data[at[cell]];
+    }
+    const int state = material[0] + PARTICLE_MAX * (material[1] + PARTICLE_MAX * (material[2] + PARTICLE_MAX * material[3]));
+    const int moves = margolus.moves[roll % BLOCK_ROLLS][state];
+    if (moves == STAY)
+        return 0;
+
+    uint8_t life[4], moisture[4];
+    for (int cell = 0; cell < 4; cell++) {
+        life[cell] = at[cell] < 0 ? 0 : grid->life[at[cell]];
+        moisture[cell] = at[cell] < 0 ? 0 : grid->moisture[at[cell]];
+    }
+    int moved = 0;
+    for (int cell = 0; cell < 4; cell++) {
+        const int from = moves >> (2 * cell) & 3;
+        if (from == cell)
+            continue;
+        grid->data[at[cell]] = material[from];
+        grid->life[at[cell]] = life[from];
+        grid->moisture[at[cell]] = moisture[from];
+        moved++;
+    }
+    return moved;
+}
+
+static int cell_at(const grid_t* grid, int x, int y)
+{
+    return x < 0 || y < 0 || x >= grid->width || y >= grid->height ? -1 : grid_index(grid, x, y);
+}
+
+// blocks with offset 1 start a cell outside the grid, so the cells along the
+// edges still pair up with a wall every other step
+static void step_rows(int begin, int end, void* user)
+{
+    const step_job_t* job = user;
+    grid_t* grid = job->grid;
+    int blocks = 0, moved = 0;
+    for (int row = begin; row < end; row++) {
+        const int y = 2 * row - job->offset;
+        const bool edge_row = y < 0 || y + 1 >= grid->height;
+        rng_t rng = make_rng(job->seed + (uint64_t)row);
+        uint64_t columns = 0;
+        uint64_t rolls = 0;
+        int rolls_left = 0;
+        for (int x = -job->offset; x < grid->width; x += 2) {
+            const bool edge = edge_row || x < 0 || x + 1 >= grid->width;
+            // settled ground and open sky go four columns at a time
+            if (!edge && x + 3 < grid->width && grid_span(grid, x) >= 4 && uniform_pair(grid, x, y)) {
+                x += 2;
+                continue;
+            }
+            if (!rolls_left) {
+                rolls = rng_next(&rng);
+                rolls_left = 64 / 3;
+            }
+            const int at[4] = {
+                edge ? cell_at(grid, x, y) : grid_index(grid, x, y),
+                edge ? cell_at(grid, x + 1, y) : grid_index(grid, x + 1, y),
+                edge ? cell_at(grid, x, y + 1) : grid_index(grid, x, y + 1),
+                edge ? cell_at(grid, x + 1, y + 1) : grid_index(grid, x + 1, y + 1),
+            };
+            const int block_moved = move_block(grid, at, rolls);
+            rolls /= BLOCK_ROLLS;
+            rolls_left--;
+            blocks += block_moved != 0;
+            moved += block_moved;
+            columns |= (uint64_t)(block_moved != 0) << ((x + 1) / 64);
+        }
+        margolus.moved_columns[row] = columns;
+    }
+    atomic_fetch_add_explicit(&margolus.blocks, blocks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&margolus.moved, moved, memory_order_relaxed);
+}
+
+void margolus_step(grid_t* grid)
+{
+    if (!margolus.built)
+        build_moves();
+    step_job_t job = {
+        .grid = grid,
+        .offset = (int)(margolus.step++ & 1),
+        .seed = rng_next(&margolus.rng),
+    };
+    atomic_store_explicit(&margolus.blocks, 0, memory_order_relaxed);
+    atomic_store_explicit(&margolus.moved, 0, memory_order_relaxed);
+    const int rows = (grid->height + job.offset + 1) / 2;
+    parallel_for(rows, step_rows, &job);
+    for (int row = 0; row < rows; row++) {
+        const int y = 2 * row - job.offset;
+        for (uint64_t columns = margolus.moved_columns[row]; columns; columns &= columns - 1) {
+            int chunk = 0;
+            while (!(columns >> chunk & 1)) {
+                chunk++;
+            }
+            // a block at x covers columns x and x + 1, x is -1 at the left edge
+            const int x0 = chunk * 64 - 1 > 0 ? chunk * 64 - 1 : 0;
+            const int x1 = chunk * 64 + 64 < grid->width ? chunk * 64 + 64 : grid->width;
+            if (y >= 0)
+                grid_touch_row(grid, y, x0, x1);
+            if (y + 1 < grid->height)
+                grid_touch_row(grid, y + 1, x0, x1);
+        }
+    }
+}
+
+margolus_stats_t margolus_stats(void)
+{
+    return (margolus_stats_t) {
+        atomic_load_explicit(&margolus.blocks, memory_order_relaxed),
+        atomic_load_explicit(&margolus.moved, memory_order_relaxed),
+    };
+}
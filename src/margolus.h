@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "game.h"
+
+// :MARGOLUS
+// A block engine for powders and liquids, picked with ENGINE_MARGOLUS. The
+// grid is cut into 2x2 blocks whose corner moves by one cell in x and y every
+// step, and each block goes to its next state through a table built once from
+// the displacement rules: straight down first, then diagonally down, then
+// liquids sideways. Blocks hanging over the edge of the grid treat the cells
+// outside as walls. A block only reads and writes its own four cells, so
+// there is no sweep order to bias the result and the rows of blocks are
+// split over the parallel pool when there is one.
+//
+// The table is indexed by the four materials and a three bit roll per block:
+// one bit picks the side tried first, the other two stand in for the sink
+// and slide chances of the classic kernels, rounded to quarters.
+
+void margolus_seed(uint64_t seed);
+
+// one step of every block, life and moisture move with their cells
+void margolus_step(grid_t* grid);
+
+typedef struct {
+    int blocks; // changed during the last step
+    int moved; // cells
+} margolus_stats_t;
+
+margolus_stats_t margolus_stats(void);
@@ -0,0 +1,301 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // sysconf under -std=c11
+#endif
+
+#include "metrics.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "heat.h"
+#include "moisture.h"
+#include "sandboard.h"
+#include "thread.h"
+
+#define LINE_SIZE (512 + PARTICLE_MAX * 48)
+
+typedef struct {
+    uint64_t tick;
+    double seconds; // since metrics_start
+    double interval_ms; // wall time the sample covers
+    int ticks;
+    float tick_ms[METRICS_WINDOW]; // ring, the last min(ticks, METRICS_WINDOW) ticks
+    int64_t moved;
+    int heat_chunks, moisture_chunks, sandboard_chunks;
+    uint32_t counts[PARTICLE_MAX];
+} sample_t;
+
+static struct {
+    atomic_bool active;
+    metrics_desc_t desc;
+    FILE* file;
+    uint64_t tick;
+    double start_ms;
+    sample_t current;
+    double current_start_ms;
+
+    // single producer (metrics_tick), single consumer (writer thread)
+    sample_t* slots;
+    atomic_uint head;
+    atomic_uint tail;
+
+    thread_t writer;
+    mutex_t mutex;
+    cond_t wake;
+    atomic_bool stopping;
+
+    atomic_uint_least64_t written, dropped;
+
+    // owned by the writer thread
+    char* line;
+    bool failed;
+} metrics;
+
+// :WRITER
+
+static int compare_floats(const void* a, const void* b)
+{
+    const float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+static float percentile(const float* sorted, int count, int percent)
+{
+    return count ? sorted[(count - 1) * percent / 100] : 0.0f;
+}
+
+// resident size of the process, -1 when unknown
+static long long resident_kb(void)
+{
+#if defined(__linux__)
+    FILE* statm = fopen("/proc/self/statm", "r");
+    long long size = 0, resident = -1;
+    if (statm) {
+        if (fscanf(statm, "%lld %lld", &size, &resident) != 2)
+            resident = -1;
+        fclose(statm);
+    }
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+static void write_sample(sample_t* sample)
+{
+    const int timed = sample->ticks < METRICS_WINDOW ? sample->ticks : METRICS_WINDOW;
+    qsort(sample->tick_ms, timed, sizeof(float), compare_floats);
+
+    char* line = metrics.line;
+    int n = snprintf(line, LINE_SIZE,
+        "{\"tick\":%llu,\"seconds\":%.3f,\"ticks_per_sec\":%.2f,"
+        "\"tick_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+        "\"moved\":%lld,\"active_chunks\":{\"heat\":%d,\"moisture\":%d,\"sandboard\":%d},\"counts\":{",
+        (unsigned long long)sample->tick, sample->seconds, sample->interval_ms > 0.0 ? sample->ticks * 1000.0 / sample->interval_ms : 0.0,
+        percentile(sample->tick_ms, timed, 50), percentile(sample->tick_ms, timed, 90), percentile(sample->tick_ms, timed, 99),
+        timed ? sample->tick_ms[timed - 1] : 0.0f, (long long)sample->moved, sample->heat_chunks, sample->moisture_chunks,
+        sample->sandboard_chunks);
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        n += snprintf(line + n, LINE_SIZE - n, "%s\"%s\":%u", m ? "," : "", particle_get_name(m), sample->counts[m]);
+    }
+    const long long memory = resident_kb();
+    if (memory < 0) {
+        n += snprintf(line + n, LINE_SIZE - n, "},\"memory_kb\":null}\n");
+    } else {
+        n += snprintf(line + n, LINE_SIZE - n, "},\"memory_kb\":%lld}\n", memory);
+    }
+
+    if (metrics.failed)
+        return;
+    if (fwrite(line, 1, n, metrics.file) != (size_t)n || fflush(metrics.file) != 0) {
+        fprintf(stderr, "Metrics: write failed, further lines are discarded\n");
+        metrics.failed = true;
+        return;
+    }
+    atomic_fetch_add_explicit(&metrics.written, 1, memory_order_relaxed);
+}
+
+static void writer_main(void* user)
+{
+    (void)user;
+    for (;;) {
+        unsigned tail = atomic_load_explicit(&metrics.tail, memory_order_relaxed);
+        mutex_lock(&metrics.mutex);
+        while (atomic_load_explicit(&metrics.head, memory_order_acquire) == tail
+            && !atomic_load(&metrics.stopping)) {
+            cond_wait(&metrics.wake, &metrics.mutex);
+        }
+        mutex_unlock(&metrics.mutex);
+        if (atomic_load_explicit(&metrics.head, memory_order_acquire) == tail)
+            break; // stopping and drained
+
+        write_sample(&metrics.slots[tail % METRICS_SLOT_COUNT]);
+        atomic_store_explicit(&metrics.tail, tail + 1, memory_order_release);
+    }
+}
+
+// :API
+
+static void free_buffers(void)
+{
+    free(metrics.slots);
+    free(metrics.line);
+    metrics.slots = NULL;
+    metrics.line = NULL;
+}
+
+bool metrics_start(const metrics_desc_t* desc)
+{
+    if (metrics_active())
+        metrics_stop();
+
+    metrics.desc = *desc;
+    if (metrics.desc.every_n < 0)
+        metrics.desc.every_n = 0;
+    metrics.tick = 0;
+    metrics.failed = false;
+    atomic_store(&metrics.head, 0);
+    atomic_store(&metrics.tail, 0);
+    atomic_store(&metrics.stopping, false);
+    atomic_store(&metrics.written, 0);
+    atomic_store(&metrics.dropped, 0);
+
+    // every buffer is allocated up front, nothing is allocated per line
+    metrics.slots = malloc(sizeof(sample_t) * METRICS_SLOT_COUNT);
+    metrics.line = malloc(LINE_SIZE);
+    if (!metrics.slots || !metrics.line) {
+        fprintf(stderr, "Metrics: out of memory\n");
+        free_buffers();
+        return false;
+    }
+
+    metrics.file = fopen(desc->path, "a");
+    if (!metrics.file) {
+        fprintf(stderr, "Metrics: failed to open %s\n", desc->path);
+        free_buffers();
+        return false;
+    }
+
+    mutex_init(&metrics.mutex);
+    cond_init(&metrics.wake);
+    if (!thread_create(&metrics.writer, writer_main, NULL)) {
+        fprintf(stderr, "Metrics: failed to start writer thread\n");
+        cond_destroy(&metrics.wake);
+        mutex_destroy(&metrics.mutex);
+        fclose(metrics.file);
+        free_buffers();
+        return false;
+    }
+    metrics.start_ms = metrics.current_start_ms = time_now_ms();
+    memset(&metrics.current, 0, sizeof(metrics.current));
+    atomic_store(&metrics.active, true);
+    return true;
+}
+
+static void count_materials(const grid_t* grid, uint32_t* counts)
+{
+    // four tables take turns so runs of one material don't wait on the same counter
+    uint32_t partial[4][PARTICLE_MAX] = { { 0 } };
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width;) {
+            const int span = grid_span(grid, x);
+            const int* cells = grid->data + grid_index(grid, x, y);
+            int i = 0;
+            for (; i + 4 <= span; i += 4) {
+                partial[0][cells[i]]++;
+                partial[1][cells[i + 1]]++;
+                partial[2][cells[i + 2]]++;
+                partial[3][cells[i + 3]]++;
+            }
+            for (; i < span; i++) {
+                partial[0][cells[i]]++;
+            }
+            x += span;
+        }
+    }
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        counts[m] = partial[0][m] + partial[1][m] + partial[2][m] + partial[3][m];
+    }
+}
+
+void metrics_tick(const grid_t* grid, float tick_ms)
+{
+    if (!metrics_active())
+        return;
+    sample_t* sample = &metrics.current;
+    sample->tick_ms[sample->ticks % METRICS_WINDOW] = tick_ms;
+    sample->ticks++;
+    sample->moved += fixed_update_moved();
+    metrics.tick++;
+
+    const double now = time_now_ms();
+    const bool due = metrics.desc.every_n ? sample->ticks >= metrics.desc.every_n : now - metrics.current_start_ms >= 1000.0;
+    if (!due)
+        return;
+    sample->tick = metrics.tick;
+    sample->seconds = (now - metrics.start_ms) / 1000.0;
+    sample->interval_ms = now - metrics.current_start_ms;
+    sample->heat_chunks = heat_stats().active_chunks;
+    sample->moisture_chunks = moisture_stats().active_chunks;
+    // sandboard_step() does not run under the margolus engine, its stats are from the last classic tick
+    sample->sandboard_chunks = game_state.engine == ENGINE_MARGOLUS ? 0 : sandboard_stats().chunks;
+    count_materials(grid, sample->counts);
+
+    const unsigned head = atomic_load_explicit(&metrics.head, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(&metrics.tail, memory_order_acquire);
+    if (head - tail >= METRICS_SLOT_COUNT) {
+        atomic_fetch_add_explicit(&metrics.dropped, 1, memory_order_relaxed);
+    } else {
+        // the slot only needs the tick times that were kept
+        sample_t* slot = &metrics.slots[head % METRICS_SLOT_COUNT];
+        const int timed = sample->ticks < METRICS_WINDOW ? sample->ticks : METRICS_WINDOW;
+        memcpy(slot, sample, offsetof(sample_t, tick_ms));
+        memcpy(slot->tick_ms, sample->tick_ms, sizeof(float) * timed);
+        memcpy(&slot->moved, &sample->moved, sizeof(sample_t) - offsetof(sample_t, moved));
+        atomic_store_explicit(&metrics.head, head + 1, memory_order_release);
+        mutex_lock(&metrics.mutex);
+        cond_signal(&metrics.wake);
+        mutex_unlock(&metrics.mutex);
+    }
+    metrics.current_start_ms = now;
+    sample->ticks = 0;
+    sample->moved = 0;
+}
+
+void metrics_stop(void)
+{
+    if (!metrics_active())
+        return;
+    mutex_lock(&metrics.mutex);
+    atomic_store(&metrics.stopping, true);
+    cond_signal(&metrics.wake);
+    mutex_unlock(&metrics.mutex);
+    thread_join(metrics.writer);
+
+    if (fclose(metrics.file) != 0)
+        fprintf(stderr, "Metrics: failed to close file\n");
+    cond_destroy(&metrics.wake);
+    mutex_destroy(&metrics.mutex);
+    free_buffers();
+    atomic_store(&metrics.active, false);
+}
+
+bool metrics_active(void)
+{
+    return atomic_load_explicit(&metrics.active, memory_order_relaxed);
+}
+
+metrics_stats_t metrics_stats(void)
+{
+    return (metrics_stats_t) {
+        .written = atomic_load_explicit(&metrics.written, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&metrics.dropped, memory_order_relaxed),
+    };
+}
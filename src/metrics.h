@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :METRICS
+// Appends one JSON object per line to a file for long unattended runs, once
+// a second or once every N ticks. The simulation thread only adds up its
+// tick into the current sample, and at the end of an interval hands the
+// sample to a background writer through a small ring of preallocated slots;
+// sorting the tick times for the percentiles, formatting and writing happen
+// on the writer. If the writer falls behind, lines are dropped instead of
+// stalling the simulation.
+//
+// A line:
+//   {"tick":1200,"seconds":24.0,"ticks_per_sec":50.0,
+//    "tick_ms":{"p50":1.9,"p90":2.4,"p99":3.1,"max":3.5},
+//    "moved":18234,"active_chunks":{"heat":12,"moisture":3,"sandboard":40},
+//    "counts":{"PARTICLE_AIR":81234,...},"memory_kb":51200}
+// moved is the cells fixed_update moved over the interval, counts are taken
+// at its last tick (the sandboard chunks are 0 under ENGINE_MARGOLUS), and
+// memory_kb is the resident size of the process, null where it is not known.
+
+#define METRICS_SLOT_COUNT 4
+#define METRICS_WINDOW 4096 // tick times kept per line, the latest ones
+
+typedef struct {
+    const char* path;
+    int every_n; // ticks per line, 0: one line per second
+} metrics_desc_t;
+
+// start and stop while the simulation is not ticking
+bool metrics_start(const metrics_desc_t* desc);
+// simulation thread, after each tick
+void metrics_tick(const grid_t* grid, float tick_ms);
+void metrics_stop(void);
+bool metrics_active(void);
+
+typedef struct {
+    uint64_t written; // lines
+    uint64_t dropped;
+} metrics_stats_t;
+
+metrics_stats_t metrics_stats(void);
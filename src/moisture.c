@@ -0,0 +1,229 @@
+#include "moisture.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heat.h"
+#include "thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    uint8_t absorb; // gained per update and touching water cell, 0: not porous
+    uint8_t wick; // sixteenths of the wettest porous neighbor's moisture drawn in
+} porosity_t;
+
+static const porosity_t porosity[PARTICLE_MAX] = {
+    [PARTICLE_SAND] = { 12, 12 },
+    [PARTICLE_WET_SAND] = { 12, 12 },
+    [PARTICLE_DIRT] = { 6, 10 },
+    [PARTICLE_MUD] = { 6, 10 },
+};
+
+typedef struct {
+    particle_t to; // PARTICLE_NONE: no transition
+    bool rising; // happens at or above `at` instead of below
+    uint8_t at;
+} transition_t;
+
+static const transition_t transitions[PARTICLE_MAX] = {
+    [PARTICLE_SAND] = { PARTICLE_WET_SAND, true, 64 },
+    [PARTICLE_WET_SAND] = { PARTICLE_SAND, false, 32 },
+    [PARTICLE_DIRT] = { PARTICLE_MUD, true, 224 },
+    [PARTICLE_MUD] = { PARTICLE_DIRT, false, 128 },
+};
+
+enum {
+    CHUNK_WATER = 1 << 0,
+    CHUNK_POROUS = 1 << 1,
+    CHUNK_DAMP = 1 << 2, // wet sand or mud, which has to be able to dry out
+};
+
+static struct {
+    uint8_t* flags; // per chunk, CHUNK_*
+    uint8_t* active;
+    int chunks_x, chunks_y;
+    int width, height;
+    unsigned tick;
+    moisture_stats_t stats;
+} moisture;
+
+bool moisture_init(const grid_t* grid)
+{
+    moisture_shutdown();
+    moisture.width = grid->width;
+    moisture.height = grid->height;
+    moisture.chunks_x = (grid->width + MOISTURE_CHUNK - 1) / MOISTURE_CHUNK;
+    moisture.chunks_y = (grid->height + MOISTURE_CHUNK - 1) / MOISTURE_CHUNK;
+    moisture.flags = calloc((size_t)moisture.chunks_x * moisture.chunks_y, 1);
+    moisture.active = calloc((size_t)moisture.chunks_x * moisture.chunks_y, 1);
+    if (!moisture.flags || !moisture.active) {
+        moisture_shutdown();
+        return false;
+    }
+    return true;
+}
+
+void moisture_shutdown(void)
+{
+    free(moisture.flags);
+    free(moisture.active);
+    memset(&moisture, 0, sizeof(moisture));
+}
+
+// :CLASSIFY
+
+static uint8_t classify_span(const int* cells, int count)
+{
+    uint8_t flags = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i water = _mm_set1_epi32(PARTICLE_WATER);
+    const __m128i sand = _mm_set1_epi32(PARTICLE_SAND);
+    const __m128i dirt = _mm_set1_epi32(PARTICLE_DIRT);
+    const __m128i wet_sand = _mm_set1_epi32(PARTICLE_WET_SAND);
+    const __m128i mud = _mm_set1_epi32(PARTICLE_MUD);
+    __m128i any_water = _mm_setzero_si128();
+    __m128i any_dry = _mm_setzero_si128();
+    __m128i any_damp = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        const __m128i group = _mm_loadu_si128((const __m128i*)(cells + i));
+        any_water = _mm_or_si128(any_water, _mm_cmpeq_epi32(group, water));
+        any_dry = _mm_or_si128(any_dry, _mm_or_si128(_mm_cmpeq_epi32(group, sand), _mm_cmpeq_epi32(group, dirt)));
+        any_damp = _mm_or_si128(any_damp, _mm_or_si128(_mm_cmpeq_epi32(group, wet_sand), _mm_cmpeq_epi32(group, mud)));
+    }
+    if (_mm_movemask_epi8(any_water))
+        flags |= CHUNK_WATER;
+    if (_mm_movemask_epi8(any_dry))
+        flags |= CHUNK_POROUS;
+    if (_mm_movemask_epi8(any_damp))
+        flags |= CHUNK_POROUS | CHUNK_DAMP;
+#endif
+    for (; i < count; i++) {
+        if (cells[i] == PARTICLE_WATER)
+            flags |= CHUNK_WATER;
+        if (porosity[cells[i]].absorb)
+            flags |= CHUNK_POROUS;
+        if (cells[i] == PARTICLE_WET_SAND || cells[i] == PARTICLE_MUD)
+            flags |= CHUNK_DAMP;
+    }
+    return flags;
+}
+
+// a chunk is updated when it holds porous material next to water in it or
+// a neighboring chunk, or damp material that may dry out
+static int classify(const grid_t* grid)
+{
+    const int cx = moisture.chunks_x, cy = moisture.chunks_y;
+    memset(moisture.flags, 0, (size_t)cx * cy);
+    for (int y = 0; y < grid->height; y++) {
+        uint8_t* flags = moisture.flags + (y / MOISTURE_CHUNK) * cx;
+        for (int x = 0; x < grid->width;) {
+            const int chunk_end = (x / MOISTURE_CHUNK + 1) * MOISTURE_CHUNK;
+            const int count = grid_span(grid, x) < chunk_end - x ? grid_span(grid, x) : chunk_end - x;
+            flags[x / MOISTURE_CHUNK] |= classify_span(grid->data + grid_index(grid, x, y), count);
+            x += count;
+        }
+    }
+
+    int active_count = 0;
+    for (int y = 0; y < cy; y++) {
+        for (int x = 0; x < cx; x++) {
+            const uint8_t flags = moisture.flags[x + y * cx];
+            uint8_t water = flags & CHUNK_WATER;
+            water |= x > 0 ? moisture.flags[x - 1 + y * cx] & CHUNK_WATER : 0;
+            water |= x + 1 < cx ? moisture.flags[x + 1 + y * cx] & CHUNK_WATER : 0;
+            water |= y > 0 ? moisture.flags[x + (y - 1) * cx] & CHUNK_WATER : 0;
+            water |= y + 1 < cy ? moisture.flags[x + (y + 1) * cx] & CHUNK_WATER : 0;
+            const bool active = (flags & CHUNK_DAMP) || ((flags & CHUNK_POROUS) && water);
+            moisture.active[x + y * cx] = active;
+            active_count += active;
+        }
+    }
+    return active_count;
+}
+
+// :UPDATE
+
+static void update_cell(grid_t* grid, int x, int y)
+{
+    const int w = grid->width;
+    const int i = grid_index(grid, x, y);
+    const int material = grid->data[i];
+    const porosity_t* p = &porosity[material];
+    if (!p->absorb) {
+        grid->moisture[i] = 0;
+        return;
+    }
+
+    int water = 0;
+    int wettest = 0;
+    const int dx[4] = { -1, 1, 0, 0 };
+    const int dy[4] = { 0, 0, -1, 1 };
+    const bool inside[4] = { x > 0, x + 1 < w, y > 0, y + 1 < grid->height };
+    for (int k = 0; k < 4; k++) {
+        if (!inside[k])
+            continue;
+        const int at = grid_index(grid, x + dx[k], y + dy[k]);
+        const int n = grid->data[at];
+        if (n == PARTICLE_WATER) {
+            water++;
+        } else if (porosity[n].absorb && grid->moisture[at] > wettest) {
+            wettest = grid->moisture[at];
+        }
+    }
+
+    int m = grid->moisture[i];
+    const int drawn = wettest * p->wick / 16;
+    if (heat_get(x, y) >= MOISTURE_BOIL) {
+        m = 0;
+    } else if (water) {
+        m = m + p->absorb * water > 255 ? 255 : m + p->absorb * water;
+    } else if (drawn > m) {
+        m += (drawn - m + 1) / 2;
+    } else {
+        m = m > MOISTURE_DRYING ? m - MOISTURE_DRYING : 0;
+    }
+    grid->moisture[i] = (uint8_t)m;
+
+    const transition_t* tr = &transitions[material];
+    // not set_cell(): the moisture byte is what moves the cell between the
+    // dry and the wet material, so it stays with the new one
+    if (tr->to != PARTICLE_NONE && (tr->rising ? m >= tr->at : m < tr->at)) {
+        grid->data[i] = tr->to;
+        grid_touch(grid, i, 1);
+    }
+}
+
+void moisture_step(grid_t* grid)
+{
+    if (!moisture.flags || grid->width != moisture.width || grid->height != moisture.height)
+        return;
+    if (++moisture.tick % MOISTURE_INTERVAL != 0)
+        return;
+
+    double start = time_now_ms();
+    moisture.stats.active_chunks = classify(grid);
+    for (int cy = 0; cy < moisture.chunks_y && moisture.stats.active_chunks; cy++) {
+        for (int cx = 0; cx < moisture.chunks_x; cx++) {
+            if (!moisture.active[cx + cy * moisture.chunks_x])
+                continue;
+            const int x1 = (cx + 1) * MOISTURE_CHUNK < grid->width ? (cx + 1) * MOISTURE_CHUNK : grid->width;
+            const int y1 = (cy + 1) * MOISTURE_CHUNK < grid->height ? (cy + 1) * MOISTURE_CHUNK : grid->height;
+            for (int y = cy * MOISTURE_CHUNK; y < y1; y++) {
+                for (int x = cx * MOISTURE_CHUNK; x < x1; x++) {
+                    update_cell(grid, x, y);
+                }
+            }
+        }
+    }
+    moisture.stats.update_ms = (float)(time_now_ms() - start);
+}
+
+moisture_stats_t moisture_stats(void)
+{
+    return moisture.stats;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :MOISTURE
+// Water soaking into porous materials. Every cell has a moisture byte in
+// grid->moisture that moves with it. Porous cells touching water absorb it
+// at a per material rate, wick a fraction of it on to drier porous
+// neighbors, and otherwise dry out slowly, or at once when their heat block
+// is above boiling. Sand that is wet enough turns into wet sand, which holds
+// together on slopes; dirt that is saturated turns into mud.
+//
+// The grid is split into MOISTURE_CHUNK x MOISTURE_CHUNK chunks. Every
+// MOISTURE_INTERVAL ticks the chunks are classified in one vectorized pass,
+// and only chunks holding porous material next to water, or wet sand or mud,
+// are updated, so a dry world skips the update entirely.
+
+#define MOISTURE_CHUNK 32 // cells per chunk side
+#define MOISTURE_INTERVAL 4 // ticks between updates
+#define MOISTURE_DRYING 1 // lost per update by a porous cell with nothing wetter nearby
+#define MOISTURE_BOIL 100.0f // degrees at which moisture is lost at once
+
+bool moisture_init(const grid_t* grid);
+void moisture_shutdown(void);
+
+// once per tick, updates every MOISTURE_INTERVAL calls
+void moisture_step(grid_t* grid);
+
+typedef struct {
+    int active_chunks;
+    float update_ms; // last update
+} moisture_stats_t;
+
+moisture_stats_t moisture_stats(void);
@@ -0,0 +1,293 @@
+#include "occupancy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static struct {
+    uint32_t* planes[OCCUPANCY_PLANES]; // NULL: not kept
+    uint32_t masks[OCCUPANCY_PLANES]; // bit n for material n
+    // the kept planes, repacked together; bit k of codes[m] is set when
+    // material m belongs to kept[k]
+    int kept[OCCUPANCY_PLANES];
+    int kept_count;
+    uint32_t codes[PARTICLE_MAX];
+    bool packed; // false after a plane was added, the next refresh packs everything
+    uint32_t* awake; // one row
+    int words;
+    int width, height;
+    occupancy_stats_t stats;
+} occupancy;
+
+static uint32_t* make_plane(void)
+{
+    return calloc((size_t)occupancy.words * occupancy.height, sizeof(uint32_t));
+}
+
+static void keep(int plane)
+{
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        occupancy.codes[m] |= (occupancy.masks[plane] >> m & 1) << occupancy.kept_count;
+    }
+    occupancy.kept[occupancy.kept_count++] = plane;
+}
+
+// :PACK
+
+// every kept plane's word of row y: each cell's code is looked up once, and
+// eight planes at a time come out of its bytes by bit position
+static void repack_word(const grid_t* grid, int y, int word)
+{
+    const int x0 = word * 32;
+    const int x1 = x0 + 32 < grid->width ? x0 + 32 : grid->width;
+    for (int first = 0; first < occupancy.kept_count; first += 8) {
+        uint8_t lanes[32] = { 0 };
+        for (int x = x0; x < x1;) {
+            const int count = grid_span(grid, x) < x1 - x ? grid_span(grid, x) : x1 - x;
+            const int* cells = grid->data + grid_index(grid, x, y);
+            for (int i = 0; i < count; i++) {
+                lanes[x - x0 + i] = (uint8_t)(occupancy.codes[cells[i]] >> first);
+            }
+            x += count;
+        }
+        const int planes = occupancy.kept_count - first < 8 ? occupancy.kept_count - first : 8;
+#if defined(__SSE2__)
+        const __m128i low = _mm_loadu_si128((const __m128i*)lanes);
+        const __m128i high = _mm_loadu_si128((const __m128i*)(lanes + 16));
+#endif
+        for (int p = 0; p < planes; p++) {
+#if defined(__SSE2__)
+            // bit p of every byte moved to its top bit
+            const __m128i shift = _mm_cvtsi32_si128(7 - p);
+            const uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_sll_epi16(low, shift))
+                | (uint32_t)_mm_movemask_epi8(_mm_sll_epi16(high, shift)) << 16;
+#else
+            uint32_t bits = 0;
+            for (int i = 0; i < 32; i++) {
+                bits |= (uint32_t)(lanes[i] >> p & 1) << i;
+            }
+#endif
+            occupancy.planes[occupancy.kept[first + p]][y * occupancy.words + word] = bits;
+        }
+    }
+    occupancy.stats.repacked++;
+}
+
+static void repack_words(const grid_t* grid, int y, int x0, int x1)
+{
+    for (int word = x0 / 32; word <= (x1 - 1) / 32; word++) {
+        repack_word(grid, y, word);
+    }
+}
+
+// the words holding the cells of one touched block
+static void repack_block(const grid_t* grid, int block)
+{
+#if defined(GRID_TILED)
+    const int tiles_x = (grid->width + GRID_TILE - 1) / GRID_TILE;
+    const int x = block % tiles_x * GRID_TILE;
+    const int y0 = block / tiles_x * GRID_TILE;
+    const int y1 = y0 + GRID_TILE < grid->height ? y0 + GRID_TILE : grid->height;
+    for (int y = y0; y < y1; y++) {
+        repack_word(grid, y, x / 32);
+    }
+#else
+    const int end = (block + 1) * GRID_BLOCK < grid->count ? (block + 1) * GRID_BLOCK : grid->count;
+    for (int i = block * GRID_BLOCK; i < end;) {
+        const int y = i / grid->width, x = i % grid->width;
+        const int count = grid->width - x < end - i ? grid->width - x : end - i;
+        repack_words(grid, y, x, x + count);
+        i += count;
+    }
+#endif
+}
+
+// :API
+
+bool occupancy_init(const grid_t* grid)
+{
+    occupancy_shutdown();
+    occupancy.width = grid->width;
+    occupancy.height = grid->height;
+    occupancy.words = (grid->width + 31) / 32;
+    occupancy.masks[OCCUPANCY_EMPTY] = 1u << PARTICLE_AIR;
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        occupancy.masks[OCCUPANCY_MATERIAL + m] = 1u << m;
+        switch (particle_get_movement(m)) {
+        case MOVE_POWDER:
+            occupancy.masks[OCCUPANCY_POWDER] |= 1u << m;
+            occupancy.masks[OCCUPANCY_POWDER_FALL] |= particle_sinks_through(m);
+            break;
+        case MOVE_LIQUID:
+            occupancy.masks[OCCUPANCY_LIQUID] |= 1u << m;
+            occupancy.masks[OCCUPANCY_LIQUID_FALL] |= particle_sinks_through(m);
+            break;
+        case MOVE_GAS:
+        case MOVE_FIRE:
+        case MOVE_PLUGIN:
+            occupancy.masks[OCCUPANCY_ACTIVE] |= 1u << m;
+            break;
+        default:
+            break;
+        }
+    }
+    occupancy.awake = calloc(occupancy.words, sizeof(uint32_t));
+    bool ok = occupancy.awake != NULL;
+    for (int plane = 0; plane < OCCUPANCY_MATERIAL; plane++) {
+        occupancy.planes[plane] = make_plane();
+        ok = ok && occupancy.planes[plane];
+        keep(plane);
+    }
+    if (!ok) {
+        occupancy_shutdown();
+        return false;
+    }
+    for (int y = 0; y < grid->height; y++) {
+        repack_words(grid, y, 0, grid->width);
+    }
+    occupancy.packed = true;
+    return true;
+}
+
+void occupancy_shutdown(void)
+{
+    for (int plane = 0; plane < OCCUPANCY_PLANES; plane++) {
+        free(occupancy.planes[plane]);
+    }
+    free(occupancy.awake);
+    memset(&occupancy, 0, sizeof(occupancy));
+}
+
+bool occupancy_track(particle_t particle)
+{
+    const int plane = OCCUPANCY_MATERIAL + particle;
+    if (!occupancy.words || occupancy.planes[plane])
+        return occupancy.planes[plane] != NULL;
+    occupancy.planes[plane] = make_plane();
+    if (!occupancy.planes[plane])
+        return false;
+    keep(plane);
+    occupancy.packed = false;
+    return true;
+}
+
+static bool matches(const grid_t* grid)
+{
+    return occupancy.words && grid->width == occupancy.width && grid->height == occupancy.height;
+}
+
+void occupancy_refresh(grid_t* grid, int y0, int y1)
+{
+    if (!matches(grid))
+        return;
+    if (!occupancy.packed) {
+        for (int y = 0; y < grid->height; y++) {
+            repack_words(grid, y, 0, grid->width);
+        }
+        memset(grid->touched, 0, sizeof(grid->touched[0]) * ((grid->count + GRID_BLOCK - 1) / GRID_BLOCK));
+        occupancy.packed = true;
+        return;
+    }
+    y0 = y0 < 0 ? 0 : y0;
+    y1 = y1 > grid->height ? grid->height : y1;
+    if (y0 >= y1)
+        return;
+#if defined(GRID_TILED)
+    const int tiles_x = (grid->width + GRID_TILE - 1) / GRID_TILE;
+    const int first = y0 / GRID_TILE * tiles_x, last = ((y1 - 1) / GRID_TILE + 1) * tiles_x;
+#else
+    const int first = y0 * grid->width / GRID_BLOCK, last = (y1 * grid->width - 1) / GRID_BLOCK + 1;
+#endif
+    for (int block = first; block < last; block++) {
+        if (grid->touched[block]) {
+            grid->touched[block] = 0;
+            repack_block(grid, block);
+        }
+    }
+}
+
+// the bits of `row` moved one column left and right, `self` adds the bits themselves
+static uint32_t spread(const uint32_t* row, int word, bool self)
+{
+    const uint32_t left = word > 0 ? row[word - 1] >> 31 : 0;
+    const uint32_t right = word + 1 < occupancy.words ? row[word + 1] << 31 : 0;
+    return (self ? row[word] : 0) | row[word] << 1 | left | row[word] >> 1 | right;
+}
+
+const uint32_t* occupancy_awake_row(grid_t* grid, int y)
+{
+    if (!matches(grid))
+        return NULL;
+    occupancy_refresh(grid, y, y + 2);
+    const uint32_t* powder = occupancy_row(OCCUPANCY_POWDER, y);
+    const uint32_t* liquid = occupancy_row(OCCUPANCY_LIQUID, y);
+    const uint32_t* active = occupancy_row(OCCUPANCY_ACTIVE, y);
+    const uint32_t* beside = occupancy_row(OCCUPANCY_LIQUID_FALL, y);
+    const uint32_t* powder_below = occupancy_row(OCCUPANCY_POWDER_FALL, y + 1);
+    const uint32_t* liquid_below = occupancy_row(OCCUPANCY_LIQUID_FALL, y + 1);
+    for (int word = 0; word < occupancy.words; word++) {
+        uint32_t awake = active[word] | (liquid[word] & spread(beside, word, false));
+        if (powder_below) {
+            awake |= powder[word] & spread(powder_below, word, true);
+            awake |= liquid[word] & spread(liquid_below, word, true);
+        }
+        occupancy.awake[word] = awake;
+    }
+    return occupancy.awake;
+}
+
+// :QUERY
+
+const uint32_t* occupancy_row(int plane, int y)
+{
+    if (!occupancy.planes[plane] || y < 0 || y >= occupancy.height)
+        return NULL;
+    return occupancy.planes[plane] + y * occupancy.words;
+}
+
+bool occupancy_any(int plane, int y, int x0, int x1)
+{
+    const uint32_t* row = occupancy_row(plane, y);
+    x0 = x0 < 0 ? 0 : x0;
+    x1 = x1 > occupancy.width ? occupancy.width : x1;
+    if (!row || x0 >= x1)
+        return false;
+    const int first = x0 / 32, last = (x1 - 1) / 32;
+    const uint32_t head = ~0u << (x0 % 32);
+    const uint32_t tail = ~0u >> (31 - (x1 - 1) % 32);
+    if (first == last)
+        return (row[first] & head & tail) != 0;
+    if (row[first] & head)
+        return true;
+    for (int word = first + 1; word < last; word++) {
+        if (row[word])
+            return true;
+    }
+    return (row[last] & tail) != 0;
+}
+
+static int bit_count(uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (int)((((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+}
+
+int occupancy_count(int plane)
+{
+    if (!occupancy.planes[plane])
+        return 0;
+    int count = 0;
+    for (int i = 0; i < occupancy.words * occupancy.height; i++) {
+        count += bit_count(occupancy.planes[plane][i]);
+    }
+    return count;
+}
+
+occupancy_stats_t occupancy_stats(void)
+{
+    return occupancy.stats;
+}
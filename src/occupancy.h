@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :OCCUPANCY
+// One bit per cell planes of the material plane, 32 cells to a word and
+// `(width + 31) / 32` words per row, bit x % 32 of word x / 32:
+// OCCUPANCY_EMPTY holds air, the class planes the materials of a movement
+// class or what they sink through, and OCCUPANCY_MATERIAL + particle the
+// cells of one material, for the materials asked for with
+// occupancy_track(). A question about a run of cells, like whether anything
+// under a plank is empty, is a few masked words instead of a call per cell.
+//
+// The planes are not repacked per tick. Writes flag the blocks they touch
+// (see grid_touch() in game.h) and occupancy_refresh() repacks the words of
+// flagged blocks only, so the cost follows what moved. fixed_update asks for
+// each row it sweeps with occupancy_awake_row(), which refreshes that row and
+// the one below and leaves out cells that cannot move: powder with nothing
+// it sinks through below it, liquid with nothing it sinks through below or
+// beside it. Settled piles and still pools are skipped a word at a time.
+//
+// The class planes follow the materials defined when occupancy_init() ran,
+// plugins are loaded before it.
+
+enum {
+    OCCUPANCY_EMPTY,
+    OCCUPANCY_POWDER,
+    OCCUPANCY_LIQUID,
+    OCCUPANCY_ACTIVE, // gas, fire and plugin cells, visited every tick
+    OCCUPANCY_POWDER_FALL, // materials some powder sinks through
+    OCCUPANCY_LIQUID_FALL, // materials some liquid sinks through
+    OCCUPANCY_MATERIAL, // + particle
+    OCCUPANCY_PLANES = OCCUPANCY_MATERIAL + PARTICLE_MAX,
+};
+
+// packs every plane from the grid
+bool occupancy_init(const grid_t* grid);
+void occupancy_shutdown(void);
+
+// keeps a plane for `particle`, packed by the next refresh; false when out of memory
+bool occupancy_track(particle_t particle);
+
+// repacks the words of the blocks flagged over rows [y0, y1) and clears
+// their flags; does nothing when the planes are not kept for this grid
+void occupancy_refresh(grid_t* grid, int y0, int y1);
+
+// the cells of row y fixed_update has to visit, refreshed first; NULL when
+// the planes are not kept for this grid. Valid until the next call.
+const uint32_t* occupancy_awake_row(grid_t* grid, int y);
+
+// the queries read the planes as of the last refresh
+// NULL when the plane is not kept or y is outside the grid
+const uint32_t* occupancy_row(int plane, int y);
+// whether any cell in [x0, x1) of row y is set
+bool occupancy_any(int plane, int y, int x0, int x1);
+int occupancy_count(int plane);
+
+typedef struct {
+    int64_t repacked; // words repacked since occupancy_init, all kept planes at once
+} occupancy_stats_t;
+
+occupancy_stats_t occupancy_stats(void);
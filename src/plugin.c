@@ -0,0 +1,269 @@
+#include "plugin.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "plugin_api.h"
+#include "runs.h"
+
+#define MAX_PLUGIN_COUNT 16
+#define PLUGIN_SLOTS (PARTICLE_MAX - PARTICLE_PLUGIN_0)
+#define PLUGIN_NAME_SIZE 32
+
+_Static_assert(sizeof(int) == sizeof(int32_t), "plugins see the material plane as int32_t");
+
+typedef struct {
+    plugin_grid_t view; // first, callbacks get a pointer to it
+    grid_t* grid;
+} grid_view_t;
+
+static struct {
+    void* libraries[MAX_PLUGIN_COUNT];
+    int library_count;
+    int material_count; // slots taken from PARTICLE_PLUGIN_0 on
+    plugin_material_t materials[PLUGIN_SLOTS];
+    char names[PLUGIN_SLOTS][PLUGIN_NAME_SIZE];
+    const char* unused_names[PLUGIN_SLOTS]; // to give a slot back
+    particle_t row_materials[PLUGIN_SLOTS]; // with an update_row
+    int row_material_count;
+    uint32_t* bits;
+    int bits_words;
+    grid_view_t view;
+} plugins;
+
+// :LIBRARY
+
+static void* open_library(const char* path)
+{
+#if defined(_WIN32)
+    return (void*)LoadLibraryA(path);
+#else
+    return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static const char* library_error(void)
+{
+#if defined(_WIN32)
+    return "LoadLibrary failed";
+#else
+    const char* error = dlerror();
+    return error ? error : "unknown error";
+#endif
+}
+
+static plugin_main_t find_entry(void* library)
+{
+    plugin_main_t entry = NULL;
+#if defined(_WIN32)
+    FARPROC symbol = GetProcAddress((HMODULE)library, PLUGIN_ENTRY);
+#else
+    void* symbol = dlsym(library, PLUGIN_ENTRY);
+#endif
+    // function and object pointers don't convert into each other in ISO C
+    memcpy(&entry, &symbol, sizeof(entry));
+    return entry;
+}
+
+static void close_library(void* library)
+{
+#if defined(_WIN32)
+    FreeLibrary((HMODULE)library);
+#else
+    dlclose(library);
+#endif
+}
+
+// :HOST
+
+static int32_t find_material(const char* name)
+{
+    for (int m = 0; name && m < PARTICLE_PLUGIN_0 + plugins.material_count; m++) {
+        if (strcmp(particle_get_name(m), name) == 0)
+            return m;
+    }
+    return -1;
+}
+
+// names end up in metrics lines and shared memory headers as they are, so
+// they are limited to letters, digits and underscores like the built in ones
+static bool valid_name(const char* name)
+{
+    if (!name || !name[0] || strlen(name) >= PLUGIN_NAME_SIZE)
+        return false;
+    for (const char* c = name; *c; c++) {
+        if (!((*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9') || *c == '_'))
+            return false;
+    }
+    return true;
+}
+
+static int32_t register_material(const plugin_material_t* desc)
+{
+    if (!desc || desc->size < offsetof(plugin_material_t, user) || plugins.material_count == PLUGIN_SLOTS)
+        return -1;
+    plugin_material_t material = { 0 };
+    memcpy(&material, desc, desc->size < sizeof(material) ? desc->size : sizeof(material));
+    const bool custom = material.update_row || material.update_cell;
+    if (!valid_name(material.name) || find_material(material.name) >= 0
+        || material.density < 0 || (!custom && (material.movement < PLUGIN_MOVE_STATIC || material.movement > PLUGIN_MOVE_LIQUID)))
+        return -1;
+
+    static const movement_t movements[] = {
+        [PLUGIN_MOVE_STATIC] = MOVE_STATIC,
+        [PLUGIN_MOVE_POWDER] = MOVE_POWDER,
+        [PLUGIN_MOVE_LIQUID] = MOVE_LIQUID,
+    };
+    const int slot = plugins.material_count++;
+    const particle_t particle = PARTICLE_PLUGIN_0 + slot;
+    strcpy(plugins.names[slot], material.name);
+    material.name = plugins.names[slot];
+    plugins.materials[slot] = material;
+    plugins.unused_names[slot] = particle_get_name(particle);
+    particle_define(particle, plugins.names[slot], material.color, material.density, custom ? MOVE_PLUGIN : movements[material.movement],
+        material.flags & PLUGIN_MATERIAL_FLUID);
+    return particle;
+}
+
+static void collect_row_materials(void)
+{
+    plugins.row_material_count = 0;
+    for (int slot = 0; slot < plugins.material_count; slot++) {
+        if (plugins.materials[slot].update_row)
+            plugins.row_materials[plugins.row_material_count++] = PARTICLE_PLUGIN_0 + slot;
+    }
+}
+
+bool plugin_load(const char* path)
+{
+    if (plugins.library_count == MAX_PLUGIN_COUNT) {
+        fprintf(stderr, "Plugin %s: more than %d plugins\n", path, MAX_PLUGIN_COUNT);
+        return false;
+    }
+    void* library = open_library(path);
+    if (!library) {
+        fprintf(stderr, "Plugin %s: %s\n", path, library_error());
+        return false;
+    }
+    const plugin_main_t entry = find_entry(library);
+    if (!entry) {
+        fprintf(stderr, "Plugin %s: no %s\n", path, PLUGIN_ENTRY);
+        close_library(library);
+        return false;
+    }
+
+    static const plugin_host_t host = { PLUGIN_ABI_VERSION, register_material, find_material };
+    const int first_slot = plugins.material_count;
+    const int32_t result = entry(&host);
+    if (result != 0) {
+        // the library goes away, so do the materials it registered
+        fprintf(stderr, "Plugin %s: %s returned %d\n", path, PLUGIN_ENTRY, (int)result);
+        for (int slot = first_slot; slot < plugins.material_count; slot++) {
+            particle_define(PARTICLE_PLUGIN_0 + slot, plugins.unused_names[slot], 0, 0, MOVE_STATIC, false);
+        }
+        plugins.material_count = first_slot;
+        close_library(library);
+        return false;
+    }
+    plugins.libraries[plugins.library_count++] = library;
+    collect_row_materials();
+    return true;
+}
+
+void plugin_shutdown(void)
+{
+    for (int slot = 0; slot < plugins.material_count; slot++) {
+        plugins.materials[slot].update_row = NULL;
+        plugins.materials[slot].update_cell = NULL;
+    }
+    plugins.row_material_count = 0;
+    for (int i = 0; i < plugins.library_count; i++) {
+        close_library(plugins.libraries[i]);
+    }
+    plugins.library_count = 0;
+    free(plugins.bits);
+    plugins.bits = NULL;
+    plugins.bits_words = 0;
+}
+
+// :UPDATE
+
+static int32_t view_index(const plugin_grid_t* view, int32_t x, int32_t y)
+{
+    return grid_index(((const grid_view_t*)view)->grid, x, y);
+}
+
+static void view_swap(const plugin_grid_t* view, int32_t a, int32_t b)
+{
+    swap_cells(((const grid_view_t*)view)->grid, a, b);
+}
+
+static const plugin_grid_t* view_of(grid_t* grid)
+{
+    plugins.view = (grid_view_t) {
+        .view = {
+            .material = (int32_t*)grid->data,
+            .life = grid->life,
+            .moisture = grid->moisture,
+            .width = grid->width,
+            .height = grid->height,
+#if defined(GRID_TILED)
+            .stride = 0,
+#else
+            .stride = grid->width,
+#endif
+            .index = view_index,
+            .swap = view_swap,
+        },
+        .grid = grid,
+    };
+    return &plugins.view.view;
+}
+
+void plugin_update_cell(grid_t* grid, int x, int y, particle_t particle)
+{
+    const plugin_material_t* material = &plugins.materials[particle - PARTICLE_PLUGIN_0];
+    if (material->update_cell && !material->update_row) {
+        material->update_cell(material->user, view_of(grid), x, y);
+        // what it wrote directly, see plugin_api.h
+        for (int dy = -1; dy <= 1; dy++) {
+            if (y + dy >= 0 && y + dy < grid->height)
+                grid_touch_row(grid, y + dy, x > 0 ? x - 1 : 0, x + 2 < grid->width ? x + 2 : grid->width);
+        }
+    }
+}
+
+void plugin_update_row(grid_t* grid, int y)
+{
+    if (!plugins.row_material_count)
+        return;
+    const int words = (grid->width + 31) / 32;
+    if (plugins.bits_words < words) {
+        uint32_t* bits = realloc(plugins.bits, sizeof(uint32_t) * words);
+        if (!bits)
+            return;
+        plugins.bits = bits;
+        plugins.bits_words = words;
+    }
+    const plugin_grid_t* view = view_of(grid);
+    for (int i = 0; i < plugins.row_material_count; i++) {
+        const particle_t particle = plugins.row_materials[i];
+        if (!pack_row(grid, y, &particle, 1, plugins.bits))
+            continue;
+        const plugin_material_t* material = &plugins.materials[particle - PARTICLE_PLUGIN_0];
+        material->update_row(material->user, view, y, plugins.bits);
+        for (int dy = -1; dy <= 1; dy++) {
+            if (y + dy >= 0 && y + dy < grid->height)
+                grid_touch_row(grid, y + dy, 0, grid->width);
+        }
+    }
+}
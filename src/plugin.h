@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :PLUGIN
+// Loads material plugins, shared libraries built against plugin_api.h, and
+// puts their materials in the PARTICLE_PLUGIN_ slots of PARTICLE_ENUM.
+// Plugins are loaded at startup, before setup_game() and the *_init()
+// functions, so every table built from the material properties sees them.
+// Materials with an update callback get the MOVE_PLUGIN class, fixed_update
+// hands their cells and rows to the plugin instead of a built in kernel.
+
+// false with a message on stderr when the library or its entry point is
+// missing, or the entry point fails
+bool plugin_load(const char* path);
+// unloads every plugin once the simulation stopped, their materials keep
+// their slots but no longer update
+void plugin_shutdown(void);
+
+// fixed_update, for MOVE_PLUGIN cells and after the kernels of each row
+void plugin_update_cell(grid_t* grid, int x, int y, particle_t particle);
+void plugin_update_row(grid_t* grid, int y);
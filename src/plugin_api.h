@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+// :PLUGIN_API
+// The C ABI between the simulation and material plugins, the only header a
+// plugin includes. A plugin is a shared library exporting PLUGIN_ENTRY, which
+// is called once when the library is loaded at startup and registers its
+// materials through the host table. The structs only ever grow at the end:
+// plugins put sizeof(plugin_material_t) in `size` and the host reads what it
+// knows of, and PLUGIN_ABI_VERSION goes up when anything else changes.
+//
+// A material either reuses a built in movement class or brings its own
+// update. update_row is the fast path: it is called once per row of the
+// classic bottom up sweep that holds the material, right after the built in
+// kernels ran on that row, with a bitmap of the row's cells of that material.
+// update_cell is called for every cell of the material instead, in sweep
+// order. Both run on the simulation thread and may read any cell. Cells
+// anywhere can be moved with swap(); materials written directly must stay
+// within one row of y, and for update_cell within one column of x, which is
+// where the host looks for changes once the callback returns.
+
+#define PLUGIN_ABI_VERSION 2
+#define PLUGIN_ENTRY "sandsim_plugin_main"
+
+#if defined(_WIN32)
+#define PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct plugin_grid_t plugin_grid_t;
+struct plugin_grid_t {
+    int32_t* material; // material ids, see find_material
+    uint8_t* life; // ticks left for temporary materials
+    uint8_t* moisture; // water soaked into porous materials
+    int32_t width;
+    int32_t height;
+    // cells from one row to the next, 0 when the grid is stored in tiles and
+    // cells have to be found with index()
+    int32_t stride;
+    int32_t (*index)(const plugin_grid_t* grid, int32_t x, int32_t y);
+    // swaps two cells with everything stored next to their materials
+    void (*swap)(const plugin_grid_t* grid, int32_t a, int32_t b);
+};
+
+typedef enum {
+    PLUGIN_MOVE_STATIC = 0,
+    PLUGIN_MOVE_POWDER = 1,
+    PLUGIN_MOVE_LIQUID = 2,
+} plugin_movement_t;
+
+typedef enum {
+    PLUGIN_MATERIAL_FLUID = 1 << 0, // other materials sink or rise through it
+} plugin_material_flags_t;
+
+// `cells`: bit x % 32 of word x / 32 is set for each cell of row y holding the material
+typedef void (*plugin_update_row_t)(void* user, const plugin_grid_t* grid, int32_t y, const uint32_t* cells);
+typedef void (*plugin_update_cell_t)(void* user, const plugin_grid_t* grid, int32_t x, int32_t y);
+
+typedef struct {
+    uint32_t size; // sizeof(plugin_material_t)
+    const char* name; // copied, up to 31 of [A-Za-z0-9_]
+    uint32_t color; // 0xRRGGBBAA
+    int32_t density; // water is 100
+    uint32_t flags; // plugin_material_flags_t
+    int32_t movement; // plugin_movement_t, used when both updates are NULL
+    void* user;
+    plugin_update_row_t update_row;
+    plugin_update_cell_t update_cell; // used when update_row is NULL
+} plugin_material_t;
+
+typedef struct {
+    uint32_t abi_version; // PLUGIN_ABI_VERSION of the host
+    // the id of the new material, -1 when the description is invalid or
+    // every plugin slot is taken
+    int32_t (*register_material)(const plugin_material_t* material);
+    // id of a built in or registered material by name, "PARTICLE_AIR" or a
+    // plugin's name, -1 when unknown
+    int32_t (*find_material)(const char* name);
+} plugin_host_t;
+
+// PLUGIN_ENTRY, returns 0 on success; a plugin built for another ABI version
+// should return nonzero
+typedef int32_t (*plugin_main_t)(const plugin_host_t* host);
@@ -0,0 +1,295 @@
+#include "raster.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+bool make_framebuffer(framebuffer_t* fb, int width, int height)
+{
+    fb->pixels = malloc(sizeof(fb->pixels[0]) * width * height);
+    fb->width = width;
+    fb->height = height;
+    return fb->pixels != NULL;
+}
+
+void destroy_framebuffer(framebuffer_t* fb)
+{
+    free(fb->pixels);
+    fb->pixels = NULL;
+}
+
+// :PALETTE
+
+typedef struct {
+    framebuffer_t* fb;
+    const int* cells; // row major, or
+    const grid_t* grid; // in the grid's layout
+    int width;
+    int tile_size;
+    uint32_t palette[PARTICLE_MAX + 1];
+} raster_job_t;
+
+static void expand_palette(uint32_t* dst, const int* src, int count, const uint32_t* palette)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i color = _mm256_i32gather_epi32((const int*)palette, index, 4);
+        _mm256_storeu_si256((__m256i*)(dst + i), color);
+    }
+#endif
+    for (; i < count; i++) {
+        assert(src[i] < PARTICLE_MAX && "Unknown particle in grid");
+        dst[i] = palette[src[i]];
+    }
+}
+
+static inline void fill_span(uint32_t* dst, uint32_t color, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i c = _mm_set1_epi32((int)color);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(dst + i), c);
+    }
+#elif defined(__ARM_NEON)
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(dst + i, c);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+// :UPSCALE
+
+static void raster_rows(int begin, int end, void* user)
+{
+    raster_job_t* job = user;
+    const int width = job->width;
+    const int tile = job->tile_size;
+    const int stride = job->fb->width;
+
+    for (int y = begin; y < end; y++) {
+        uint32_t* row = job->fb->pixels + (size_t)y * tile * stride;
+        if (job->grid) {
+            for (int x = 0; x < width;) {
+                const int span = grid_span(job->grid, x);
+                expand_palette(row + x, job->grid->data + grid_index(job->grid, x, y), span, job->palette);
+                x += span;
+            }
+        } else {
+            expand_palette(row, job->cells + y * width, width, job->palette);
+        }
+
+        // widen in place, back to front, so row[x] is read before it is overwritten
+        if (tile > 1) {
+            for (int x = width - 1; x >= 0; x--) {
+                fill_span(row + x * tile, row[x], tile);
+            }
+        }
+        for (int i = 1; i < tile; i++) {
+            memcpy(row + i * stride, row, sizeof(row[0]) * stride);
+        }
+    }
+}
+
+static void make_raster_job(raster_job_t* job, framebuffer_t* fb, const int* cells, int width, int height, int tile_size)
+{
+    assert(fb->width == width * tile_size && "framebuffer width mismatch");
+    assert(fb->height == height * tile_size && "framebuffer height mismatch");
+    (void)height;
+
+    *job = (raster_job_t) { .fb = fb, .cells = cells, .width = width, .tile_size = tile_size };
+    for (int i = 0; i <= PARTICLE_MAX; i++) {
+        job->palette[i] = particle_get_color(i);
+    }
+}
+
+void raster_cells(framebuffer_t* fb, const int* cells, int width, int height, int tile_size)
+{
+    raster_job_t job;
+    make_raster_job(&job, fb, cells, width, height, tile_size);
+    raster_rows(0, height, &job);
+}
+
+void raster_grid(framebuffer_t* fb, const grid_t* grid)
+{
+    raster_job_t job;
+    make_raster_job(&job, fb, NULL, grid->width, grid->height, grid->tile_size);
+    job.grid = grid;
+    parallel_for(grid->height, raster_rows, &job);
+}
+
+// :IMAGE
+
+static inline void unpack_rgba(uint32_t color, uint8_t* out)
+{
+    out[0] = color & 0xff;
+    out[1] = (color >> 8) & 0xff;
+    out[2] = (color >> 16) & 0xff;
+    out[3] = (color >> 24) & 0xff;
+}
+
+bool write_ppm(const framebuffer_t* fb, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    uint8_t* row = malloc((size_t)fb->width * 3);
+    bool ok = row != NULL && fprintf(file, "P6\n%d %d\n255\n", fb->width, fb->height) > 0;
+    for (int y = 0; ok && y < fb->height; y++) {
+        for (int x = 0; x < fb->width; x++) {
+            uint8_t rgba[4];
+            unpack_rgba(fb->pixels[y * fb->width + x], rgba);
+            memcpy(row + x * 3, rgba, 3);
+        }
+        ok = fwrite(row, 3, fb->width, file) == (size_t)fb->width;
+    }
+    free(row);
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// Uncompressed PNG: zlib stream made of stored deflate blocks, no external deps.
+
+typedef struct {
+    FILE* file;
+    uint32_t crc;
+    uint32_t adler_a, adler_b;
+    bool ok;
+} png_writer_t;
+
+static uint32_t crc_table[256];
+
+static void make_crc_table(void)
+{
+    if (crc_table[1])
+        return;
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static void png_put(png_writer_t* w, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        w->crc = crc_table[(w->crc ^ bytes[i]) & 0xff] ^ (w->crc >> 8);
+    }
+    w->ok = w->ok && fwrite(data, 1, size, w->file) == size;
+}
+
+static void png_put_u32(png_writer_t* w, uint32_t v)
+{
+    uint8_t be[4] = { v >> 24, v >> 16, v >> 8, v };
+    png_put(w, be, 4);
+}
+
+static void png_put_zdata(png_writer_t* w, const uint8_t* data, size_t size)
+{
+    // 5552 is the largest run that cannot overflow adler_b before the modulo
+    for (size_t i = 0; i < size;) {
+        size_t end = size - i > 5552 ? i + 5552 : size;
+        for (; i < end; i++) {
+            w->adler_a += data[i];
+            w->adler_b += w->adler_a;
+        }
+        w->adler_a %= 65521;
+        w->adler_b %= 65521;
+    }
+    png_put(w, data, size);
+}
+
+static void png_begin_chunk(png_writer_t* w, uint32_t length, const char* type)
+{
+    png_put_u32(w, length);
+    w->crc = 0xffffffffu;
+    png_put(w, type, 4);
+}
+
+static void png_end_chunk(png_writer_t* w)
+{
+    png_put_u32(w, w->crc ^ 0xffffffffu);
+}
+
+bool write_png(const framebuffer_t* fb, const char* path)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    const size_t row_size = 1 + (size_t)fb->width * 4; // filter byte + RGBA
+    const size_t raw_size = row_size * fb->height;
+    const size_t block_max = 65535;
+    const size_t block_count = (raw_size + block_max - 1) / block_max;
+    const size_t zlib_size = 2 + raw_size + 5 * block_count + 4;
+    if (zlib_size > 0x7fffffffu) {
+        fprintf(stderr, "Image too large for PNG: %dx%d\n", fb->width, fb->height);
+        return false;
+    }
+
+    make_crc_table();
+    png_writer_t w = { .file = fopen(path, "wb"), .adler_a = 1, .ok = true };
+    if (!w.file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    uint8_t* row = malloc(row_size);
+    w.ok = row != NULL;
+    w.ok = w.ok && fwrite(signature, 1, sizeof(signature), w.file) == sizeof(signature);
+
+    png_begin_chunk(&w, 13, "IHDR");
+    png_put_u32(&w, fb->width);
+    png_put_u32(&w, fb->height);
+    png_put(&w, (uint8_t[]) { 8, 6, 0, 0, 0 }, 5); // 8 bit RGBA, no interlace
+    png_end_chunk(&w);
+
+    png_begin_chunk(&w, (uint32_t)zlib_size, "IDAT");
+    png_put(&w, (uint8_t[]) { 0x78, 0x01 }, 2);
+    size_t block_left = 0;
+    size_t written = 0;
+    for (int y = 0; w.ok && y < fb->height; y++) {
+        row[0] = 0;
+        for (int x = 0; x < fb->width; x++) {
+            unpack_rgba(fb->pixels[y * fb->width + x], row + 1 + x * 4);
+        }
+        for (size_t offset = 0; offset < row_size;) {
+            if (block_left == 0) {
+                block_left = raw_size - written < block_max ? raw_size - written : block_max;
+                uint8_t last = written + block_left == raw_size;
+                uint8_t header[5] = { last, block_left & 0xff, block_left >> 8, ~block_left & 0xff, (~block_left >> 8) & 0xff };
+                png_put(&w, header, 5);
+            }
+            size_t n = row_size - offset < block_left ? row_size - offset : block_left;
+            png_put_zdata(&w, row + offset, n);
+            offset += n;
+            written += n;
+            block_left -= n;
+        }
+    }
+    png_put_u32(&w, (w.adler_b << 16) | w.adler_a);
+    png_end_chunk(&w);
+
+    png_begin_chunk(&w, 0, "IEND");
+    png_end_chunk(&w);
+
+    free(row);
+    w.ok = fclose(w.file) == 0 && w.ok;
+    return w.ok;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :RASTER
+// CPU fallback for the grid pipeline, used for headless frame capture.
+// Pixels are stored in the same byte order as the GPU instance colors
+// (R, G, B, A in memory), so they match particle_get_color exactly.
+
+typedef struct {
+    uint32_t* pixels;
+    int width;
+    int height;
+} framebuffer_t;
+
+bool make_framebuffer(framebuffer_t* fb, int width, int height);
+void destroy_framebuffer(framebuffer_t* fb);
+
+// fb must be grid->width * tile_size by grid->height * tile_size
+void raster_grid(framebuffer_t* fb, const grid_t* grid);
+// single threaded, for callers that already run off the main thread
+void raster_cells(framebuffer_t* fb, const int* cells, int width, int height, int tile_size);
+
+bool write_ppm(const framebuffer_t* fb, const char* path);
+bool write_png(const framebuffer_t* fb, const char* path);
@@ -0,0 +1,135 @@
+#include "react.h"
+
+#include <stdbool.h>
+
+#include "rng.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    float chance; // per tick and touching neighbor
+    particle_t self; // what the material becomes, PARTICLE_NONE: unchanged
+    particle_t other; // what the neighbor becomes, PARTICLE_NONE: unchanged
+} reaction_t;
+
+// [material][neighbor]
+static const reaction_t reactions[PARTICLE_MAX][PARTICLE_MAX] = {
+    [PARTICLE_FIRE][PARTICLE_WATER] = { 0.5f, PARTICLE_SMOKE, PARTICLE_STEAM },
+    [PARTICLE_WET_SAND][PARTICLE_FIRE] = { 0.05f, PARTICLE_SAND, PARTICLE_NONE },
+};
+
+_Static_assert(PARTICLE_MAX <= 32, "reaction masks hold one bit per material");
+
+static rng_t react_rng = { 0x6a09e667f3bcc909ull };
+
+static struct {
+    bool built;
+    uint32_t partners[PARTICLE_MAX]; // bit n set: reacts with neighbor material n
+    uint32_t thresholds[PARTICLE_MAX][PARTICLE_MAX];
+    particle_t reactive[PARTICLE_MAX]; // materials with any partner
+    int reactive_count;
+} masks;
+
+void react_seed(uint64_t seed)
+{
+    react_rng = make_rng(seed);
+}
+
+static void build_masks(void)
+{
+    masks.reactive_count = 0;
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        masks.partners[m] = 0;
+        for (int n = 0; n < PARTICLE_MAX; n++) {
+            masks.thresholds[m][n] = rng_threshold(reactions[m][n].chance);
+            if (masks.thresholds[m][n])
+                masks.partners[m] |= 1u << n;
+        }
+        if (masks.partners[m])
+            masks.reactive[masks.reactive_count++] = m;
+    }
+    masks.built = true;
+}
+
+static void react_cell(grid_t* grid, int x, int y)
+{
+    const int w = grid->width;
+    const int i = grid_index(grid, x, y);
+    const int material = grid->data[i];
+    const uint32_t partners = masks.partners[material];
+
+    // left, right, up, down; outside the grid reads as PARTICLE_NONE, which reacts with nothing
+    const bool inside[4] = { x > 0, x + 1 < w, y > 0, y + 1 < grid->height };
+    const int at[4] = {
+        inside[0] ? grid_index(grid, x - 1, y) : i,
+        inside[1] ? grid_index(grid, x + 1, y) : i,
+        inside[2] ? grid_index(grid, x, y - 1) : i,
+        inside[3] ? grid_index(grid, x, y + 1) : i,
+    };
+    int neighbor[4];
+    for (int k = 0; k < 4; k++) {
+        neighbor[k] = inside[k] ? grid->data[at[k]] : PARTICLE_NONE;
+    }
+    const uint32_t touching = (1u << neighbor[0] | 1u << neighbor[1] | 1u << neighbor[2] | 1u << neighbor[3]) & partners;
+    if (!touching)
+        return;
+
+    // each touching neighbor gets its own roll, starting from a random side
+    const uint32_t start = rng_u32(&react_rng);
+    for (int k = 0; k < 4; k++) {
+        const int side = (start + k) & 3;
+        const int n = neighbor[side];
+        if (!(touching & 1u << n) || !rng_chance(&react_rng, masks.thresholds[material][n]))
+            continue;
+        const reaction_t* reaction = &reactions[material][n];
+        if (reaction->self != PARTICLE_NONE)
+            set_cell(grid, i, reaction->self);
+        if (reaction->other != PARTICLE_NONE)
+            set_cell(grid, at[side], reaction->other);
+        return;
+    }
+}
+
+void react_step(grid_t* grid)
+{
+    if (!masks.built)
+        build_masks();
+    if (masks.reactive_count == 0)
+        return;
+
+#if defined(__SSE2__)
+    __m128i reactive[PARTICLE_MAX];
+    const int reactive_count = masks.reactive_count;
+    for (int r = 0; r < reactive_count; r++) {
+        reactive[r] = _mm_set1_epi32(masks.reactive[r]);
+    }
+#endif
+    for (int y = 0; y < grid->height; y++) {
+        for (int x0 = 0; x0 < grid->width;) {
+            const int* cells = grid->data + grid_index(grid, x0, y);
+            const int span = grid_span(grid, x0);
+            int i = 0;
+#if defined(__SSE2__)
+            for (; i + 4 <= span; i += 4) {
+                const __m128i group = _mm_loadu_si128((const __m128i*)(cells + i));
+                __m128i hit = _mm_cmpeq_epi32(group, reactive[0]);
+                for (int r = 1; r < reactive_count; r++) {
+                    hit = _mm_or_si128(hit, _mm_cmpeq_epi32(group, reactive[r]));
+                }
+                int mask = _mm_movemask_epi8(hit);
+                for (int lane = 0; mask; lane++, mask >>= 4) {
+                    if (mask & 1)
+                        react_cell(grid, x0 + i + lane, y);
+                }
+            }
+#endif
+            for (; i < span; i++) {
+                if (masks.partners[cells[i]])
+                    react_cell(grid, x0 + i, y);
+            }
+            x0 += span;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "game.h"
+
+// :REACT
+// Material interactions that need no movement: water puts fire out, fire
+// dries wet sand. Wetting is gradual and lives in moisture.h. Each pair of
+// (material, neighbor material) has an entry in a 2D table with the chance
+// per tick and what each side turns into. From it a mask of the neighbor
+// materials each material reacts with is precomputed, so the reaction pass
+// rejects cells of inert materials four at a time and never looks at their
+// neighbors. The movement kernel in update_particle knows nothing about
+// reactions.
+
+void react_seed(uint64_t seed);
+
+// once per tick after fixed_update
+void react_step(grid_t* grid);
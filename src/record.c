@@ -0,0 +1,370 @@
+#include "record.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raster.h"
+#include "thread.h"
+
+static struct {
+    atomic_bool active; // written by the recording thread, read anywhere
+    record_desc_t desc;
+    FILE* file;
+    int width, height, tile_size;
+    uint64_t calls;
+
+    // single producer (record_frame), single consumer (writer thread)
+    struct {
+        int* cells;
+        uint64_t frame;
+    } slots[RECORD_SLOT_COUNT];
+    atomic_uint head;
+    atomic_uint tail;
+
+    thread_t writer;
+    mutex_t mutex;
+    cond_t wake;
+    cond_t space;
+    atomic_bool stopping;
+
+    atomic_uint_least64_t captured, dropped, written, bytes;
+
+    // owned by the writer thread
+    uint8_t* plane;
+    uint8_t* prev;
+    uint8_t* encoded;
+    framebuffer_t fb;
+    bool failed;
+} recorder;
+
+static void put_bytes(const void* data, size_t size)
+{
+    if (recorder.failed)
+        return;
+    if (fwrite(data, 1, size, recorder.file) != size) {
+        fprintf(stderr, "Recording: write failed, further frames are discarded\n");
+        recorder.failed = true;
+        return;
+    }
+    atomic_fetch_add_explicit(&recorder.bytes, size, memory_order_relaxed);
+}
+
+static void put_u32(uint32_t v)
+{
+    uint8_t le[4] = { v, v >> 8, v >> 16, v >> 24 };
+    put_bytes(le, 4);
+}
+
+static size_t encode_varint(uint8_t* out, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+// :ENCODERS
+
+static int frame_tile_size(void)
+{
+    return recorder.desc.source == RECORD_SOURCE_RGBA ? recorder.tile_size : 1;
+}
+
+static void pack_plane(const int* cells, int count)
+{
+    for (int i = 0; i < count; i++) {
+        assert(cells[i] >= 0 && cells[i] < PARTICLE_MAX && "Unknown particle in grid");
+        recorder.plane[i] = (uint8_t)cells[i];
+    }
+}
+
+static void write_raw(const int* cells)
+{
+    int count = recorder.width * recorder.height;
+    if (recorder.desc.source == RECORD_SOURCE_GRID) {
+        pack_plane(cells, count);
+        put_bytes(recorder.plane, count);
+    } else {
+        raster_cells(&recorder.fb, cells, recorder.width, recorder.height, recorder.tile_size);
+        put_bytes(recorder.fb.pixels, sizeof(recorder.fb.pixels[0]) * recorder.fb.width * recorder.fb.height);
+    }
+}
+
+static void write_y4m(const int* cells)
+{
+    framebuffer_t* fb = &recorder.fb;
+    raster_cells(fb, cells, recorder.width, recorder.height, frame_tile_size());
+
+    // BT.601 limited range, one plane at a time
+    const int count = fb->width * fb->height;
+    uint8_t* y_plane = recorder.encoded;
+    uint8_t* u_plane = y_plane + count;
+    uint8_t* v_plane = u_plane + count;
+    for (int i = 0; i < count; i++) {
+        uint32_t c = fb->pixels[i];
+        int r = c & 0xff, g = (c >> 8) & 0xff, b = (c >> 16) & 0xff;
+        y_plane[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u_plane[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v_plane[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    put_bytes("FRAME\n", 6);
+    put_bytes(recorder.encoded, (size_t)count * 3);
+}
+
+static void write_delta(const int* cells, uint64_t frame)
+{
+    // runs closer than this are merged, the skip/length header costs more than the gap
+    enum { MERGE_GAP = 3 };
+    const int count = recorder.width * recorder.height;
+    const uint8_t* cur = recorder.plane;
+    const uint8_t* prev = recorder.prev;
+    pack_plane(cells, count);
+
+    uint8_t* out = recorder.encoded;
+    size_t size = 0;
+    int last = 0;
+    for (int i = 0; i < count;) {
+        if (cur[i] == prev[i]) {
+            i++;
+            continue;
+        }
+        int start = i;
+        int end = i + 1;
+        for (int j = end; j < count && j - end < MERGE_GAP; j++) {
+            if (cur[j] != prev[j])
+                end = j + 1;
+        }
+        size += encode_varint(out + size, start - last);
+        size += encode_varint(out + size, end - start);
+        memcpy(out + size, cur + start, end - start);
+        size += end - start;
+        last = end;
+        i = end;
+    }
+    memcpy(recorder.prev, cur, count);
+
+    put_u32((uint32_t)frame);
+    put_u32((uint32_t)size);
+    put_bytes(out, size);
+}
+
+static void write_header(void)
+{
+    switch (recorder.desc.format) {
+    case RECORD_FORMAT_RAW:
+        break;
+    case RECORD_FORMAT_Y4M: {
+        char header[128];
+        int tile = frame_tile_size();
+        int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+            recorder.width * tile, recorder.height * tile, recorder.desc.fps);
+        put_bytes(header, n);
+    } break;
+    case RECORD_FORMAT_DELTA:
+        put_bytes("SANDDLT1", 8);
+        put_u32(recorder.width);
+        put_u32(recorder.height);
+        put_u32(recorder.tile_size);
+        break;
+    }
+}
+
+// :WRITER
+
+static void writer_main(void* user)
+{
+    (void)user;
+    write_header();
+    for (;;) {
+        unsigned tail = atomic_load_explicit(&recorder.tail, memory_order_relaxed);
+        mutex_lock(&recorder.mutex);
+        while (atomic_load_explicit(&recorder.head, memory_order_acquire) == tail
+            && !atomic_load(&recorder.stopping)) {
+            cond_wait(&recorder.wake, &recorder.mutex);
+        }
+        mutex_unlock(&recorder.mutex);
+        if (atomic_load_explicit(&recorder.head, memory_order_acquire) == tail)
+            break; // stopping and drained
+
+        const int* cells = recorder.slots[tail % RECORD_SLOT_COUNT].cells;
+        uint64_t frame = recorder.slots[tail % RECORD_SLOT_COUNT].frame;
+        switch (recorder.desc.format) {
+        case RECORD_FORMAT_RAW:
+            write_raw(cells);
+            break;
+        case RECORD_FORMAT_Y4M:
+            write_y4m(cells);
+            break;
+        case RECORD_FORMAT_DELTA:
+            write_delta(cells, frame);
+            break;
+        }
+        atomic_store_explicit(&recorder.tail, tail + 1, memory_order_release);
+        if (!recorder.failed)
+            atomic_fetch_add_explicit(&recorder.written, 1, memory_order_relaxed);
+        if (recorder.desc.lossless) {
+            mutex_lock(&recorder.mutex);
+            cond_signal(&recorder.space);
+            mutex_unlock(&recorder.mutex);
+        }
+    }
+}
+
+// :API
+
+static void free_buffers(void)
+{
+    for (int i = 0; i < RECORD_SLOT_COUNT; i++) {
+        free(recorder.slots[i].cells);
+        recorder.slots[i].cells = NULL;
+    }
+    free(recorder.plane);
+    free(recorder.prev);
+    free(recorder.encoded);
+    destroy_framebuffer(&recorder.fb);
+    recorder.plane = recorder.prev = recorder.encoded = NULL;
+}
+
+bool record_start(const record_desc_t* desc, const grid_t* grid)
+{
+    if (record_active())
+        record_stop();
+
+    recorder.desc = *desc;
+    if (recorder.desc.every_n < 1)
+        recorder.desc.every_n = 1;
+    if (recorder.desc.fps < 1)
+        recorder.desc.fps = 60;
+    recorder.width = grid->width;
+    recorder.height = grid->height;
+    recorder.tile_size = grid->tile_size;
+    recorder.calls = 0;
+    recorder.failed = false;
+    atomic_store(&recorder.head, 0);
+    atomic_store(&recorder.tail, 0);
+    atomic_store(&recorder.stopping, false);
+    atomic_store(&recorder.captured, 0);
+    atomic_store(&recorder.dropped, 0);
+    atomic_store(&recorder.written, 0);
+    atomic_store(&recorder.bytes, 0);
+
+    // every buffer is allocated up front, nothing is allocated per frame
+    const size_t count = (size_t)grid->width * grid->height;
+    const int tile = frame_tile_size();
+    const size_t pixel_count = count * tile * tile;
+    bool ok = true;
+    for (int i = 0; i < RECORD_SLOT_COUNT; i++) {
+        recorder.slots[i].cells = malloc(sizeof(int) * count);
+        ok = ok && recorder.slots[i].cells;
+    }
+    recorder.plane = malloc(count);
+    recorder.prev = calloc(count, 1); // first delta is against an all PARTICLE_NONE plane
+    recorder.encoded = malloc(pixel_count * 3 > count * 6 + 16 ? pixel_count * 3 : count * 6 + 16);
+    ok = ok && recorder.plane && recorder.prev && recorder.encoded;
+    ok = ok && make_framebuffer(&recorder.fb, grid->width * tile, grid->height * tile);
+    if (!ok) {
+        fprintf(stderr, "Recording: out of memory\n");
+        free_buffers();
+        return false;
+    }
+
+    recorder.file = fopen(desc->path, "wb");
+    if (!recorder.file) {
+        fprintf(stderr, "Recording: failed to open %s\n", desc->path);
+        free_buffers();
+        return false;
+    }
+
+    mutex_init(&recorder.mutex);
+    cond_init(&recorder.wake);
+    cond_init(&recorder.space);
+    if (!thread_create(&recorder.writer, writer_main, NULL)) {
+        fprintf(stderr, "Recording: failed to start writer thread\n");
+        cond_destroy(&recorder.space);
+        cond_destroy(&recorder.wake);
+        mutex_destroy(&recorder.mutex);
+        fclose(recorder.file);
+        free_buffers();
+        return false;
+    }
+    atomic_store(&recorder.active, true);
+    return true;
+}
+
+void record_frame(const grid_t* grid)
+{
+    if (!record_active())
+        return;
+    uint64_t frame = recorder.calls++;
+    if (frame % recorder.desc.every_n != 0)
+        return;
+    assert(grid->width == recorder.width && grid->height == recorder.height && "grid resized while recording");
+
+    unsigned head = atomic_load_explicit(&recorder.head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&recorder.tail, memory_order_acquire);
+    if (head - tail >= RECORD_SLOT_COUNT && recorder.desc.lossless) {
+        mutex_lock(&recorder.mutex);
+        while (head - atomic_load_explicit(&recorder.tail, memory_order_acquire) >= RECORD_SLOT_COUNT) {
+            cond_wait(&recorder.space, &recorder.mutex);
+        }
+        mutex_unlock(&recorder.mutex);
+    } else if (head - tail >= RECORD_SLOT_COUNT) {
+        atomic_fetch_add_explicit(&recorder.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    // recordings are row major whatever the grid layout
+    int* cells = recorder.slots[head % RECORD_SLOT_COUNT].cells;
+    for (int y = 0; y < grid->height; y++) {
+        int* row = cells + y * grid->width;
+        const int* src = grid_row(grid, y, row);
+        if (src != row)
+            memcpy(row, src, sizeof(row[0]) * grid->width);
+    }
+    recorder.slots[head % RECORD_SLOT_COUNT].frame = frame;
+    atomic_store_explicit(&recorder.head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&recorder.captured, 1, memory_order_relaxed);
+
+    mutex_lock(&recorder.mutex);
+    cond_signal(&recorder.wake);
+    mutex_unlock(&recorder.mutex);
+}
+
+void record_stop(void)
+{
+    if (!record_active())
+        return;
+    mutex_lock(&recorder.mutex);
+    atomic_store(&recorder.stopping, true);
+    cond_signal(&recorder.wake);
+    mutex_unlock(&recorder.mutex);
+    thread_join(recorder.writer);
+
+    if (fclose(recorder.file) != 0)
+        fprintf(stderr, "Recording: failed to close file\n");
+    cond_destroy(&recorder.space);
+    cond_destroy(&recorder.wake);
+    mutex_destroy(&recorder.mutex);
+    free_buffers();
+    atomic_store(&recorder.active, false);
+}
+
+bool record_active(void)
+{
+    return atomic_load_explicit(&recorder.active, memory_order_relaxed);
+}
+
+record_stats_t record_stats(void)
+{
+    return (record_stats_t) {
+        .captured = atomic_load_explicit(&recorder.captured, memory_order_relaxed),
+        .dropped = atomic_load_explicit(&recorder.dropped, memory_order_relaxed),
+        .written = atomic_load_explicit(&recorder.written, memory_order_relaxed),
+        .bytes = atomic_load_explicit(&recorder.bytes, memory_order_relaxed),
+    };
+}
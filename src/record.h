@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :RECORD
+// Captures every Nth frame into a small ring of preallocated slots. The
+// calling thread only copies the material plane; rasterizing and encoding
+// happen on a background writer thread. If the writer falls behind, frames
+// are dropped instead of stalling the caller.
+//
+// Formats:
+//  RAW    concatenated frames, 1 byte per cell (GRID) or RGBA8 per pixel (RGBA)
+//  Y4M    YUV4MPEG2, 4:4:4, at cell (GRID) or pixel (RGBA) resolution
+//  DELTA  material plane only, little endian:
+//           header "SANDDLT1", u32 width, u32 height, u32 tile_size
+//           frame  u32 frame, u32 payload size, payload
+//           payload: repeated (varint skip, varint length, length bytes)
+//           of cells that changed since the previous recorded frame
+
+#define RECORD_SLOT_COUNT 4
+
+typedef enum {
+    RECORD_SOURCE_GRID,
+    RECORD_SOURCE_RGBA,
+} record_source_t;
+
+typedef enum {
+    RECORD_FORMAT_RAW,
+    RECORD_FORMAT_Y4M,
+    RECORD_FORMAT_DELTA,
+} record_format_t;
+
+typedef struct {
+    const char* path;
+    record_source_t source;
+    record_format_t format;
+    int every_n; // capture one frame out of every_n calls to record_frame
+    int fps; // Y4M frame rate
+    bool lossless; // wait for a free slot instead of dropping (offline capture)
+} record_desc_t;
+
+typedef struct {
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t written;
+    uint64_t bytes;
+} record_stats_t;
+
+// start, frame and stop must be called from the same thread (the simulation),
+// active and stats can be read from anywhere
+bool record_start(const record_desc_t* desc, const grid_t* grid);
+void record_frame(const grid_t* grid);
+void record_stop(void);
+bool record_active(void);
+record_stats_t record_stats(void);
@@ -0,0 +1,419 @@
+#include "rigid.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runs.h"
+
+#define NO_RUN (-1)
+
+static const particle_t solids[] = { PARTICLE_WOOD, PARTICLE_GLASS };
+
+static struct {
+    uint32_t* solid; // one bit per cell, `words` words per row
+    uint32_t* labeled; // the bitmap the runs describe
+    int words;
+    int width, height;
+    bool valid; // runs match `labeled`
+
+    // run slots, free ones are chained through row_next from free_run
+    run_t* runs;
+    int* parent; // union-find, the root stands for the body
+    int* row_next; // next run to the right in the same row
+    int* body_next; // circular list of the runs of a body
+    int8_t* motion; // per root run, 1: sinks, -1: rises
+    uint32_t sinks[PARTICLE_MAX];
+    uint32_t rises[PARTICLE_MAX];
+    int* mark; // stamp of the last relabel that reset the run's body
+    int capacity;
+    int free_run;
+    int* row_head; // leftmost run of each row
+
+    int* members; // runs of the bodies being reset
+    int* rows; // rows to join with their neighbors
+    int* row_mark; // stamp of the last time the row was queued
+    int row_count;
+    int stamp;
+
+    rigid_stats_t stats;
+} rigid;
+
+bool rigid_init(const grid_t* grid)
+{
+    rigid_shutdown();
+    rigid.width = grid->width;
+    rigid.height = grid->height;
+    rigid.words = (grid->width + 31) / 32;
+    rigid.solid = calloc((size_t)rigid.words * grid->height, sizeof(uint32_t));
+    rigid.labeled = calloc((size_t)rigid.words * grid->height, sizeof(uint32_t));
+    rigid.row_head = malloc(sizeof(int) * grid->height);
+    rigid.rows = malloc(sizeof(int) * grid->height);
+    rigid.row_mark = calloc(grid->height, sizeof(int));
+    if (!rigid.solid || !rigid.labeled || !rigid.row_head || !rigid.rows || !rigid.row_mark) {
+        rigid_shutdown();
+        return false;
+    }
+    rigid.free_run = NO_RUN;
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        rigid.sinks[m] = particle_sinks_through(m);
+        rigid.rises[m] = particle_rises_through(m);
+    }
+    return true;
+}
+
+void rigid_shutdown(void)
+{
+    free(rigid.solid);
+    free(rigid.labeled);
+    free(rigid.runs);
+    free(rigid.parent);
+    free(rigid.row_next);
+    free(rigid.body_next);
+    free(rigid.motion);
+    free(rigid.mark);
+    free(rigid.row_head);
+    free(rigid.members);
+    free(rigid.rows);
+    free(rigid.row_mark);
+    memset(&rigid, 0, sizeof(rigid));
+}
+
+// :RUNS
+
+static bool grow(void)
+{
+    const int capacity = rigid.capacity ? rigid.capacity * 2 : 4096;
+#define GROW(array)                                                         \
+    do {                                                                    \
+        void* grown = realloc(rigid.array, sizeof(*rigid.array) * capacity); \
+        if (!grown)                                                         \
+            return false;                                                   \
+        rigid.array = grown;                                                \
+    } while (0)
+    GROW(runs);
+    GROW(parent);
+    GROW(row_next);
+    GROW(body_next);
+    GROW(motion);
+    GROW(mark);
+    GROW(members);
+#undef GROW
+    for (int run = capacity - 1; run >= rigid.capacity; run--) {
+        rigid.mark[run] = 0;
+        rigid.row_next[run] = rigid.free_run;
+        rigid.free_run = run;
+    }
+    rigid.capacity = capacity;
+    return true;
+}
+
+// a body of its own, linked after `left` in row y or first when left is NO_RUN
+static int add_run(int y, int x0, int x1, int left)
+{
+    if (rigid.free_run == NO_RUN && !grow())
+        return NO_RUN;
+    const int run = rigid.free_run;
+    rigid.free_run = rigid.row_next[run];
+    rigid.runs[run] = (run_t) { y, x0, x1 };
+    rigid.parent[run] = run;
+    rigid.body_next[run] = run;
+    int* link = left == NO_RUN ? &rigid.row_head[y] : &rigid.row_next[left];
+    rigid.row_next[run] = *link;
+    *link = run;
+    return run;
+}
+
+static void unlink_run(int run)
+{
+    int* link = &rigid.row_head[rigid.runs[run].y];
+    while (*link != run) {
+        link = &rigid.row_next[*link];
+    }
+    *link = rigid.row_next[run];
+}
+
+// keeps the row sorted by x
+static void link_run(int run)
+{
+    int* link = &rigid.row_head[rigid.runs[run].y];
+    while (*link != NO_RUN && rigid.runs[*link].x0 < rigid.runs[run].x0) {
+        link = &rigid.row_next[*link];
+    }
+    rigid.row_next[run] = *link;
+    *link = run;
+}
+
+static int find(int run)
+{
+    int* parent = rigid.parent;
+    while (parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+static void unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+        return;
+    rigid.parent[a > b ? a : b] = a < b ? a : b;
+    // swapping one successor of each ring splices them into one
+    const int next = rigid.body_next[a];
+    rigid.body_next[a] = rigid.body_next[b];
+    rigid.body_next[b] = next;
+}
+
+// joins the runs of row y with the overlapping runs of row y + 1, and with
+// the runs right next to them in row y, which moving bodies can leave
+static void join_row(int y)
+{
+    for (int a = rigid.row_head[y]; a != NO_RUN && rigid.row_next[a] != NO_RUN; a = rigid.row_next[a]) {
+        if (rigid.runs[a].x1 == rigid.runs[rigid.row_next[a]].x0)
+            unite(a, rigid.row_next[a]);
+    }
+    if (y + 1 >= rigid.height)
+        return;
+    int a = rigid.row_head[y], b = rigid.row_head[y + 1];
+    while (a != NO_RUN && b != NO_RUN) {
+        const run_t* up = &rigid.runs[a];
+        const run_t* down = &rigid.runs[b];
+        if (up->x0 < down->x1 && down->x0 < up->x1)
+            unite(a, b);
+        if (up->x1 < down->x1) {
+            a = rigid.row_next[a];
+        } else {
+            b = rigid.row_next[b];
+        }
+    }
+}
+
+static void queue_row(int y)
+{
+    if (rigid.row_mark[y] != rigid.stamp) {
+        rigid.row_mark[y] = rigid.stamp;
+        rigid.rows[rigid.row_count++] = y;
+    }
+}
+
+// joins every queued row with the rows above and below it
+static void join_queued(void)
+{
+    for (int i = 0; i < rigid.row_count; i++) {
+        const int y = rigid.rows[i];
+        if (y > 0)
+            join_row(y - 1);
+        join_row(y);
+    }
+    rigid.row_count = 0;
+}
+
+// :RELABEL
+// Rows whose packed bits differ from `labeled` were edited since the last
+// tick. Their runs are rebuilt from the bitmap, and every body that had a run
+// there is split back into single runs, since an edit can cut a body in two.
+// Then the rebuilt rows and the rows of those runs are joined with their
+// neighbors again. Bodies away from the edits keep their labels, and bodies
+// that moved were shifted in place by rigid_step, so a tick without edits
+// costs the comparison only.
+
+static void reset_body(int run)
+{
+    int count = 0;
+    int member = run;
+    do {
+        rigid.mark[member] = rigid.stamp;
+        rigid.members[count++] = member;
+        queue_row(rigid.runs[member].y);
+        member = rigid.body_next[member];
+    } while (member != run);
+    for (int i = 0; i < count; i++) {
+        rigid.parent[rigid.members[i]] = rigid.members[i];
+        rigid.body_next[rigid.members[i]] = rigid.members[i];
+    }
+}
+
+static bool rebuild_row(int y)
+{
+    const uint32_t* bits = rigid.solid + y * rigid.words;
+    for (int run = rigid.row_head[y]; run != NO_RUN;) {
+        const int next = rigid.row_next[run];
+        rigid.row_next[run] = rigid.free_run;
+        rigid.free_run = run;
+        run = next;
+    }
+    rigid.row_head[y] = NO_RUN;
+    int left = NO_RUN;
+    for (int x = 0, x0, x1; next_run(bits, rigid.width, &x, &x0, &x1);) {
+        left = add_run(y, x0, x1, left);
+        if (left == NO_RUN)
+            return false;
+    }
+    memcpy(rigid.labeled + y * rigid.words, bits, sizeof(uint32_t) * rigid.words);
+    queue_row(y);
+    return true;
+}
+
+static bool relabel(void)
+{
+    rigid.stamp++;
+    rigid.row_count = 0;
+    rigid.stats.relabeled_rows = 0;
+    if (!rigid.valid) {
+        // every slot back on the free list, every row rebuilt
+        for (int run = rigid.capacity - 1; run >= 0; run--) {
+            rigid.row_next[run] = run == rigid.capacity - 1 ? NO_RUN : run + 1;
+        }
+        rigid.free_run = rigid.capacity ? 0 : NO_RUN;
+        for (int y = 0; y < rigid.height; y++) {
+            rigid.row_head[y] = NO_RUN;
+        }
+    }
+    for (int y = 0; y < rigid.height; y++) {
+        const size_t offset = (size_t)y * rigid.words;
+        if (rigid.valid && memcmp(rigid.solid + offset, rigid.labeled + offset, sizeof(uint32_t) * rigid.words) == 0)
+            continue;
+        for (int run = rigid.row_head[y]; run != NO_RUN; run = rigid.row_next[run]) {
+            if (rigid.mark[run] != rigid.stamp)
+                reset_body(run);
+        }
+        if (!rebuild_row(y)) {
+            rigid.valid = false;
+            return false;
+        }
+        rigid.stats.relabeled_rows++;
+    }
+    join_queued();
+    rigid.valid = true;
+    return true;
+}
+
+// :STEP
+
+// whether every cell next to the run in row y + dy either belongs to the body
+// or is a fluid the run's material moves through (`through`)
+static bool run_free(const grid_t* grid, const run_t* run, int dy, const uint32_t* through)
+{
+    const int y = run->y + dy;
+    if (y < 0 || y >= grid->height)
+        return false;
+    const uint32_t* solid = rigid.solid + y * rigid.words;
+    for (int x = run->x0; x < run->x1; x++) {
+        const int cell = grid->data[grid_index(grid, x, run->y)];
+        if (!test_bit(solid, x) && !(through[cell] & 1u << grid->data[grid_index(grid, x, y)]))
+            return false;
+    }
+    return true;
+}
+
+// swaps the run with the row dy away, the fluid there ends up where the body was
+//
+// Keep swap_span() here, not a swap_cells() loop: GCC 12 (seen with 12.2 at
+// -O1 and -O2) miscompiles that loop. After ivopts, its local-pure-const pass
+// takes the induction variable `grid * -3` for a NULL memory access, marks
+// move_run pure, and DCE then deletes every call, so bodies never move.
+// -fno-ivopts hides it; --bench rigid (the rigid_bodies_land test) fails
+// when it comes back.
+static void move_run(grid_t* grid, const run_t* run, int dy)
+{
+    for (int x = run->x0; x < run->x1;) {
+        const int count = grid_span(grid, x) < run->x1 - x ? grid_span(grid, x) : run->x1 - x;
+        swap_span(grid, grid_index(grid, x, run->y), grid_index(grid, x, run->y + dy), count);
+        x += count;
+    }
+}
+
+static void fill_bits(uint32_t* row, int x0, int x1, bool set)
+{
+    for (int x = x0; x < x1;) {
+        const int bit = x % 32;
+        const int count = 32 - bit < x1 - x ? 32 - bit : x1 - x;
+        const uint32_t mask = (count == 32 ? 0xffffffffu : (1u << count) - 1) << bit;
+        row[x / 32] = set ? row[x / 32] | mask : row[x / 32] & ~mask;
+        x += count;
+    }
+}
+
+// moves the runs of row y whose body goes dy, in the grid, in `labeled` and
+// in the row lists; the labels stay valid without a relabel
+static void move_row(grid_t* grid, int y, int dy)
+{
+    for (int run = rigid.row_head[y]; run != NO_RUN;) {
+        const int next = rigid.row_next[run];
+        if (rigid.motion[find(run)] == dy) {
+            run_t* moved = &rigid.runs[run];
+            move_run(grid, moved, dy);
+            unlink_run(run);
+            fill_bits(rigid.labeled + y * rigid.words, moved->x0, moved->x1, false);
+            moved->y += dy;
+            fill_bits(rigid.labeled + moved->y * rigid.words, moved->x0, moved->x1, true);
+            link_run(run);
+            queue_row(moved->y);
+        }
+        run = next;
+    }
+}
+
+void rigid_step(grid_t* grid)
+{
+    rigid.stats.moving = 0;
+    if (!rigid.solid || grid->width != rigid.width || grid->height != rigid.height)
+        return;
+
+    pack_bits(grid, solids, sizeof(solids) / sizeof(solids[0]), rigid.solid);
+    if (!relabel()) {
+        fprintf(stderr, "Rigid: out of memory, skipping step\n");
+        return;
+    }
+
+    // a body sinks when nothing under it holds it up, or else rises when it is fully submerged in something denser
+    rigid.stats.bodies = 0;
+    for (int y = 0; y < rigid.height; y++) {
+        for (int run = rigid.row_head[y]; run != NO_RUN; run = rigid.row_next[run]) {
+            if (rigid.parent[run] == run) {
+                rigid.motion[run] = 1 | 2; // may sink, may rise
+                rigid.stats.bodies++;
+            }
+        }
+    }
+    for (int y = 0; y < rigid.height; y++) {
+        for (int run = rigid.row_head[y]; run != NO_RUN; run = rigid.row_next[run]) {
+            const int body = find(run);
+            if ((rigid.motion[body] & 1) && !run_free(grid, &rigid.runs[run], 1, rigid.sinks))
+                rigid.motion[body] &= ~1;
+            if ((rigid.motion[body] & 2) && !run_free(grid, &rigid.runs[run], -1, rigid.rises))
+                rigid.motion[body] &= ~2;
+        }
+    }
+    for (int y = 0; y < rigid.height; y++) {
+        for (int run = rigid.row_head[y]; run != NO_RUN; run = rigid.row_next[run]) {
+            if (rigid.parent[run] == run) {
+                rigid.motion[run] = rigid.motion[run] & 1 ? 1 : rigid.motion[run] & 2 ? -1 : 0;
+                rigid.stats.moving += rigid.motion[run] != 0;
+            }
+        }
+    }
+    if (!rigid.stats.moving)
+        return;
+
+    // sinking bodies move bottom up and rising ones top down, so each run
+    // swaps with the fluid the run ahead of it just pushed back; then the
+    // rows they moved into are joined, a body may have come to touch another
+    rigid.stamp++;
+    for (int y = rigid.height - 1; y >= 0; y--) {
+        move_row(grid, y, 1);
+    }
+    for (int y = 0; y < rigid.height; y++) {
+        move_row(grid, y, -1);
+    }
+    join_queued();
+}
+
+rigid_stats_t rigid_stats(void)
+{
+    return rigid.stats;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :RIGID
+// Solid materials (wood, glass) are grouped into bodies: 4-connected
+// components of solid cells, kept as horizontal runs joined with union-find.
+// A body with only lighter fluids under it sinks as a whole, one row per
+// tick, by swapping each of its runs with the row below, bottom up; the
+// fluid ends up where the body was. A body fully submerged in a denser
+// fluid rises the same way, so wood floats up to the surface of water and
+// glass sinks to the bottom. Either way a plank keeps its shape instead of
+// crumbling like sand.
+//
+// Labels are kept between ticks. A body that moves takes its runs along, so
+// falling needs no relabel. Rows whose packed solid bits changed otherwise,
+// because something was drawn, burnt or melted, are rebuilt, and only the
+// bodies that had a run in them are joined again, see :RELABEL in rigid.c.
+
+bool rigid_init(const grid_t* grid);
+void rigid_shutdown(void);
+
+// once per tick after fixed_update
+void rigid_step(grid_t* grid);
+
+typedef struct {
+    int bodies;
+    int moving; // sinking or rising last tick
+    int relabeled_rows; // rebuilt from the bitmap last tick
+} rigid_stats_t;
+
+rigid_stats_t rigid_stats(void);
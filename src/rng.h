@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// :RNG
+// xorshift64*, a few cycles per call, used where rand() is too slow.
+
+typedef struct {
+    uint64_t state;
+} rng_t;
+
+static inline rng_t make_rng(uint64_t seed)
+{
+    // splitmix64 scramble so small seeds still give a well mixed, non zero state
+    uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return (rng_t) { z ? z : 1 };
+}
+
+static inline uint64_t rng_next(rng_t* rng)
+{
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+static inline uint32_t rng_u32(rng_t* rng)
+{
+    return (uint32_t)(rng_next(rng) >> 32);
+}
+
+// probability in 1/65536 units, see rng_threshold
+static inline bool rng_chance(rng_t* rng, uint32_t threshold)
+{
+    return (rng_u32(rng) >> 16) < threshold;
+}
+
+static inline uint32_t rng_threshold(float probability)
+{
+    if (probability <= 0.0f)
+        return 0;
+    if (probability >= 1.0f)
+        return 65536;
+    return (uint32_t)(probability * 65536.0f);
+}
@@ -0,0 +1,211 @@
+#include "runs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// :PACK
+
+_Static_assert(PARTICLE_MAX <= 32, "material masks hold one bit per material");
+
+static uint32_t pack_word(const int* cells, int count, const particle_t* materials, int material_count)
+{
+    uint32_t bits = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        const __m128i group = _mm_loadu_si128((const __m128i*)(cells + i));
+        __m128i eq = _mm_cmpeq_epi32(group, _mm_set1_epi32(materials[0]));
+        for (int m = 1; m < material_count; m++) {
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi32(group, _mm_set1_epi32(materials[m])));
+        }
+        bits |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        for (int m = 0; m < material_count; m++) {
+            bits |= (uint32_t)(cells[i] == (int)materials[m]) << i;
+        }
+    }
+    return bits;
+}
+
+// for longer material lists: bit n of `mask` set for material n, one test per cell however many materials
+static uint32_t pack_word_mask(const int* cells, int count, uint32_t mask)
+{
+    uint32_t bits = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i wanted = _mm_set1_epi32((int)mask);
+    const __m128i bias = _mm_set1_epi32(127);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i group = _mm_loadu_si128((const __m128i*)(cells + i));
+        // 1 << material through the exponent of a float, SSE2 has no per lane shift
+        const __m128i bit = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(group, bias), 23)));
+        const __m128i miss = _mm_cmpeq_epi32(_mm_and_si128(bit, wanted), _mm_setzero_si128());
+        bits |= (uint32_t)(~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xf) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        bits |= (mask >> cells[i] & 1) << i;
+    }
+    return bits;
+}
+
+bool pack_row(const grid_t* grid, int y, const particle_t* materials, int material_count, uint32_t* bits)
+{
+    uint32_t mask = 0;
+    for (int m = 0; m < material_count; m++) {
+        mask |= 1u << materials[m];
+    }
+    uint32_t any = 0;
+    for (int x = 0; x < grid->width; x += 32) {
+        uint32_t word = 0;
+        for (int bit = 0; bit < 32 && x + bit < grid->width;) {
+            const int count = grid_span(grid, x + bit) < 32 - bit ? grid_span(grid, x + bit) : 32 - bit;
+            const int* cells = grid->data + grid_index(grid, x + bit, y);
+            word |= (material_count > 2 ? pack_word_mask(cells, count, mask) : pack_word(cells, count, materials, material_count)) << bit;
+            bit += count;
+        }
+        bits[x / 32] = word;
+        any |= word;
+    }
+    return any != 0;
+}
+
+void pack_bits(const grid_t* grid, const particle_t* materials, int material_count, uint32_t* bits)
+{
+    const int words = (grid->width + 31) / 32;
+    for (int y = 0; y < grid->height; y++) {
+        pack_row(grid, y, materials, material_count, bits + y * words);
+    }
+}
+
+// :LABELS
+
+bool make_run_labels(run_labels_t* labels, int width, int height)
+{
+    *labels = (run_labels_t) { 0 };
+    labels->width = width;
+    labels->height = height;
+    labels->words = (width + 31) / 32;
+    labels->row_start = calloc(height + 1, sizeof(int));
+    return labels->row_start != NULL;
+}
+
+void destroy_run_labels(run_labels_t* labels)
+{
+    free(labels->runs);
+    free(labels->parent);
+    free(labels->row_start);
+    *labels = (run_labels_t) { 0 };
+}
+
+int run_labels_find(run_labels_t* labels, int run)
+{
+    int* parent = labels->parent;
+    while (parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+static void unite(run_labels_t* labels, int a, int b)
+{
+    a = run_labels_find(labels, a);
+    b = run_labels_find(labels, b);
+    if (a != b)
+        labels->parent[a > b ? a : b] = a < b ? a : b;
+}
+
+static bool push_run(run_labels_t* labels, int y, int x0, int x1)
+{
+    if (labels->count == labels->capacity) {
+        int capacity = labels->capacity ? labels->capacity * 2 : 4096;
+        run_t* runs = realloc(labels->runs, sizeof(run_t) * capacity);
+        if (!runs)
+            return false;
+        labels->runs = runs;
+        int* parent = realloc(labels->parent, sizeof(int) * capacity);
+        if (!parent)
+            return false;
+        labels->parent = parent;
+        labels->capacity = capacity;
+    }
+    labels->parent[labels->count] = labels->count;
+    labels->runs[labels->count++] = (run_t) { y, x0, x1 };
+    return true;
+}
+
+// first column from x on whose bit is `set`, width when there is none;
+// words that are all the other value are skipped whole
+static int scan_bits(const uint32_t* row, int width, int x, bool set)
+{
+    while (x < width) {
+        const uint32_t word = (set ? row[x / 32] : ~row[x / 32]) >> (x % 32);
+        if (word == 0) {
+            x += 32 - x % 32;
+        } else if (word & 1) {
+            return x;
+        } else {
+            x++;
+        }
+    }
+    return width;
+}
+
+bool next_run(const uint32_t* row, int width, int* x, int* x0, int* x1)
+{
+    *x0 = scan_bits(row, width, *x, true);
+    if (*x0 >= width)
+        return false;
+    *x1 = scan_bits(row, width, *x0, false);
+    *x = *x1;
+    return true;
+}
+
+static bool find_runs(run_labels_t* labels, const uint32_t* bits, int y)
+{
+    for (int x = 0, x0, x1; next_run(bits, labels->width, &x, &x0, &x1);) {
+        if (!push_run(labels, y, x0, x1))
+            return false;
+    }
+    return true;
+}
+
+// joins the runs of row y with the overlapping runs of row y - 1
+static void join_rows(run_labels_t* labels, int y)
+{
+    int a = labels->row_start[y - 1], a_end = labels->row_start[y];
+    int b = labels->row_start[y], b_end = labels->row_start[y + 1];
+    while (a < a_end && b < b_end) {
+        const run_t* up = &labels->runs[a];
+        const run_t* down = &labels->runs[b];
+        if (up->x0 < down->x1 && down->x0 < up->x1)
+            unite(labels, a, b);
+        if (up->x1 < down->x1) {
+            a++;
+        } else {
+            b++;
+        }
+    }
+}
+
+bool run_labels_build(run_labels_t* labels, const uint32_t* bits)
+{
+    labels->count = 0;
+    for (int y = 0; y < labels->height; y++) {
+        labels->row_start[y] = labels->count;
+        if (!find_runs(labels, bits + y * labels->words, y))
+            return false;
+    }
+    labels->row_start[labels->height] = labels->count;
+    for (int y = 1; y < labels->height; y++) {
+        join_rows(labels, y);
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :RUNS
+// Connected component labeling on a packed bitmap, one bit per cell and
+// 32 cells to a word. Set bits are split into horizontal runs, and runs
+// that overlap a run in the row above are joined with union-find
+// (4-connectivity). Empty words are skipped, so the cost follows the
+// number of runs, not the size of the grid.
+
+typedef struct {
+    int y, x0, x1; // x1 exclusive
+} run_t;
+
+typedef struct {
+    int width, height;
+    int words; // per row
+    run_t* runs;
+    int* parent;
+    int count, capacity;
+    int* row_start; // first run of each row, height + 1 entries
+} run_labels_t;
+
+// sets the bit of every cell holding one of `materials`
+void pack_bits(const grid_t* grid, const particle_t* materials, int material_count, uint32_t* bits);
+// one row of pack_bits, returns whether any bit was set
+bool pack_row(const grid_t* grid, int y, const particle_t* materials, int material_count, uint32_t* bits);
+static inline bool test_bit(const uint32_t* row, int x)
+{
+    return row[x / 32] >> (x % 32) & 1;
+}
+// the next run of set bits in a packed row, [x0, x1), starting at column *x,
+// which is moved past it; false when there is none left. Bits past `width`
+// must be clear, as pack_row leaves them.
+bool next_run(const uint32_t* row, int width, int* x, int* x0, int* x1);
+
+bool make_run_labels(run_labels_t* labels, int width, int height);
+void destroy_run_labels(run_labels_t* labels);
+
+// replaces the runs with those of `bits`, false when out of memory
+bool run_labels_build(run_labels_t* labels, const uint32_t* bits);
+int run_labels_find(run_labels_t* labels, int run);
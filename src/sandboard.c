@@ -0,0 +1,191 @@
+#include "sandboard.h"
+
+#include "rng.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static struct {
+    rng_t rng;
+    bool disabled;
+    sandboard_stats_t stats;
+} sandboard = { { 0x2545f4914f6cdd1dull }, false, { 0 } };
+
+void sandboard_seed(uint64_t seed)
+{
+    sandboard.rng = make_rng(seed);
+}
+
+void sandboard_set_enabled(bool enabled)
+{
+    sandboard.disabled = !enabled;
+}
+
+// :PACK
+
+// sand and air bits of the `count` cells from x0 in row y, false when any of them is damp
+static bool pack_chunk_row(const grid_t* grid, int x0, int y, int count, uint64_t* sand, uint64_t* air)
+{
+    uint64_t s = 0, a = 0;
+    uint8_t damp = 0;
+    for (int bit = 0; bit < count;) {
+        const int n = grid_span(grid, x0 + bit) < count - bit ? grid_span(grid, x0 + bit) : count - bit;
+        const int at = grid_index(grid, x0 + bit, y);
+        const int* cells = grid->data + at;
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i sand4 = _mm_set1_epi32(PARTICLE_SAND);
+        const __m128i air4 = _mm_set1_epi32(PARTICLE_AIR);
+        for (; i + 4 <= n; i += 4) {
+            const __m128i group = _mm_loadu_si128((const __m128i*)(cells + i));
+            s |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, sand4))) << (bit + i);
+            a |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, air4))) << (bit + i);
+        }
+#endif
+        for (; i < n; i++) {
+            s |= (uint64_t)(cells[i] == PARTICLE_SAND) << (bit + i);
+            a |= (uint64_t)(cells[i] == PARTICLE_AIR) << (bit + i);
+        }
+        i = 0;
+#if defined(__SSE2__)
+        __m128i wet = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            wet = _mm_or_si128(wet, _mm_loadu_si128((const __m128i*)(grid->moisture + at + i)));
+        }
+        damp |= _mm_movemask_epi8(_mm_cmpeq_epi8(wet, _mm_setzero_si128())) != 0xffff;
+#endif
+        for (; i < n; i++) {
+            damp |= grid->moisture[at + i];
+        }
+        bit += n;
+    }
+    *sand = s;
+    *air = a;
+    return damp == 0;
+}
+
+#if defined(__SSE2__)
+// all ones in lane k when bit k of the index is set
+#define NIBBLE(n) { -((n) & 1), -((n) >> 1 & 1), -((n) >> 2 & 1), -((n) >> 3 & 1) }
+static const int32_t nibble_lanes[16][4] = {
+    NIBBLE(0), NIBBLE(1), NIBBLE(2), NIBBLE(3), NIBBLE(4), NIBBLE(5), NIBBLE(6), NIBBLE(7),
+    NIBBLE(8), NIBBLE(9), NIBBLE(10), NIBBLE(11), NIBBLE(12), NIBBLE(13), NIBBLE(14), NIBBLE(15)
+};
+#undef NIBBLE
+#endif
+
+// writes sand or air into the cells of `changed`
+static void write_chunk_row(grid_t* grid, int x0, int y, int count, uint64_t sand, uint64_t changed)
+{
+    for (int bit = 0; bit < count && changed >> bit;) {
+        const int n = grid_span(grid, x0 + bit) < count - bit ? grid_span(grid, x0 + bit) : count - bit;
+        const uint64_t written = n == 64 ? changed : changed >> bit & ((1ull << n) - 1);
+        if (written)
+            grid_touch(grid, grid_index(grid, x0 + bit, y), n);
+        int* cells = grid->data + grid_index(grid, x0 + bit, y);
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i sand4 = _mm_set1_epi32(PARTICLE_SAND);
+        const __m128i air4 = _mm_set1_epi32(PARTICLE_AIR);
+        for (; i + 4 <= n; i += 4) {
+            const int nibble = (int)(changed >> (bit + i) & 0xf);
+            if (!nibble)
+                continue;
+            const __m128i write = _mm_loadu_si128((const __m128i*)nibble_lanes[nibble]);
+            const __m128i is_sand = _mm_loadu_si128((const __m128i*)nibble_lanes[sand >> (bit + i) & 0xf]);
+            const __m128i value = _mm_or_si128(_mm_and_si128(is_sand, sand4), _mm_andnot_si128(is_sand, air4));
+            const __m128i old = _mm_loadu_si128((const __m128i*)(cells + i));
+            _mm_storeu_si128((__m128i*)(cells + i), _mm_or_si128(_mm_and_si128(write, value), _mm_andnot_si128(write, old)));
+        }
+#endif
+        for (; i < n; i++) {
+            if (changed >> (bit + i) & 1)
+                cells[i] = sand >> (bit + i) & 1 ? PARTICLE_SAND : PARTICLE_AIR;
+        }
+        bit += n;
+    }
+}
+
+static int bit_count(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    return (int)((((v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full) * 0x0101010101010101ull) >> 56);
+}
+
+// :STEP
+
+// one tick of a chunk, rows bottom up; `free_below` is the air under the
+// chunk, the bits sand fell into are returned
+static uint64_t step_chunk(uint64_t* sand, int rows, uint64_t columns, uint64_t free_below)
+{
+    uint64_t landed_below = 0;
+    for (int r = rows - 1; r >= 0; r--) {
+        uint64_t empty = r + 1 < rows ? ~sand[r + 1] & columns : free_below;
+        const uint64_t cells = sand[r];
+        const uint64_t fall = cells & empty;
+        empty &= ~fall;
+        const uint64_t rest = cells & ~fall;
+        const uint64_t can_left = rest & empty << 1;
+        const uint64_t can_right = rest & empty >> 1;
+        // cells that could go either way take the side of their coin
+        const uint64_t coin = rng_next(&sandboard.rng);
+        const uint64_t left = can_left & (coin | ~can_right);
+        uint64_t right = can_right & ~left;
+        // two cells apart sliding toward each other, the left mover wins the gap
+        right &= ~((left >> 1 & right << 1) >> 1);
+        const uint64_t landed = fall | left >> 1 | right << 1;
+        sand[r] = rest & ~left & ~right;
+        if (r + 1 < rows)
+            sand[r + 1] |= landed;
+        else
+            landed_below = landed;
+        sandboard.stats.moved += bit_count(fall | left | right);
+    }
+    return landed_below;
+}
+
+uint64_t sandboard_step(grid_t* grid, int y0, int y1)
+{
+    if (y1 == grid->height)
+        sandboard.stats = (sandboard_stats_t) { 0 };
+    const int chunks = (grid->width + 63) / 64;
+    if (sandboard.disabled || chunks > 64 || y1 - y0 > SANDBOARD_ROWS)
+        return 0;
+
+    uint64_t stepped = 0;
+    uint64_t sand[SANDBOARD_ROWS], before[SANDBOARD_ROWS];
+    for (int c = 0; c < chunks; c++) {
+        const int x0 = c * 64;
+        const int count = grid->width - x0 < 64 ? grid->width - x0 : 64;
+        const uint64_t columns = count == 64 ? ~0ull : (1ull << count) - 1;
+        bool pure = true;
+        for (int y = y0; y < y1 && pure; y++) {
+            uint64_t air;
+            pure = pack_chunk_row(grid, x0, y, count, &sand[y - y0], &air) && (sand[y - y0] | air) == columns;
+            before[y - y0] = sand[y - y0];
+        }
+        if (!pure)
+            continue;
+        uint64_t below_sand = 0, free_below = 0;
+        if (y1 < grid->height)
+            pack_chunk_row(grid, x0, y1, count, &below_sand, &free_below);
+
+        const uint64_t landed_below = step_chunk(sand, y1 - y0, columns, free_below);
+        for (int y = y0; y < y1; y++) {
+            if (sand[y - y0] != before[y - y0])
+                write_chunk_row(grid, x0, y, count, sand[y - y0], sand[y - y0] ^ before[y - y0]);
+        }
+        if (landed_below)
+            write_chunk_row(grid, x0, y1, count, landed_below, landed_below);
+        stepped |= 1ull << c;
+        sandboard.stats.chunks++;
+    }
+    return stepped;
+}
+
+sandboard_stats_t sandboard_stats(void)
+{
+    return sandboard.stats;
+}
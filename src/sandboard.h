@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :SANDBOARD
+// A bitboard engine for sand falling through air. fixed_update sweeps the
+// grid in bands of SANDBOARD_ROWS rows, bottom band first, and hands every
+// band to sandboard_step() before its own sweep. Each 64 column chunk of the
+// band that holds nothing but dry sand and air is packed into one 64-bit
+// word per row and stepped bottom up a row at a time: falls, left slides and
+// right slides for the whole row come out of a few shifts and masks, and a
+// random word picks the side for cells that could slide either way. Sand
+// may fall out of the bottom of a chunk into air below it but never slides
+// out of its sides. fixed_update then skips the chunks that were stepped.
+
+#define SANDBOARD_ROWS 32 // rows per band, chunks are 64 columns wide
+
+void sandboard_seed(uint64_t seed);
+void sandboard_set_enabled(bool enabled); // on by default
+
+// steps the sand and air only chunks of rows [y0, y1), returns bit c set
+// for each chunk c it stepped, covering columns [64c, 64c + 64)
+uint64_t sandboard_step(grid_t* grid, int y0, int y1);
+
+typedef struct {
+    int chunks; // stepped during the last fixed_update
+    int moved; // cells
+} sandboard_stats_t;
+
+sandboard_stats_t sandboard_stats(void);
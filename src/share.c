@@ -0,0 +1,264 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // shm_open, ftruncate under -std=c11
+#endif
+
+#include "share.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+_Static_assert(PARTICLE_MAX <= 256, "the shared plane holds one byte per cell");
+
+static struct {
+    share_header_t* header;
+    size_t size;
+    char name[256];
+    uint8_t* scratch; // one packed row
+    uint32_t* row_counts; // per buffer, row and material
+} share;
+
+static size_t segment_size(int width, int height)
+{
+    return sizeof(share_header_t) + 2 * (size_t)width * height;
+}
+
+#if defined(_WIN32)
+
+bool share_start(const char* name, const grid_t* grid)
+{
+    (void)grid;
+    fprintf(stderr, "Share %s: shared memory export needs POSIX\n", name);
+    return false;
+}
+
+void share_stop(void)
+{
+}
+
+const share_header_t* share_attach(const char* name)
+{
+    (void)name;
+    return NULL;
+}
+
+void share_detach(const share_header_t* header)
+{
+    (void)header;
+}
+
+#else
+
+// a created segment is always a new one: whatever a crashed run or another
+// instance left under the name is unlinked first, so the planes start zeroed
+// and no two writers share a segment
+static void* map_segment(const char* name, size_t size, bool create)
+{
+    if (create)
+        shm_unlink(name);
+    const int fd = shm_open(name, create ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0644);
+    if (fd < 0)
+        return NULL;
+    if (create && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void* memory = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the segment alive
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+bool share_start(const char* name, const grid_t* grid)
+{
+    share_stop();
+    if (strlen(name) >= sizeof(share.name)) {
+        fprintf(stderr, "Share %s: name too long\n", name);
+        return false;
+    }
+    const size_t size = segment_size(grid->width, grid->height);
+    share.scratch = malloc(grid->width);
+    share.row_counts = calloc((size_t)2 * grid->height * PARTICLE_MAX, sizeof(uint32_t));
+    share_header_t* header = share.scratch && share.row_counts ? map_segment(name, size, true) : NULL;
+    if (!header) {
+        fprintf(stderr, "Share %s: could not create the segment\n", name);
+        share_stop();
+        return false;
+    }
+    memset(header, 0, sizeof(*header));
+    header->size = (uint32_t)size;
+    header->width = (uint32_t)grid->width;
+    header->height = (uint32_t)grid->height;
+    header->material_count = PARTICLE_MAX;
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        snprintf(header->names[m], SHARE_NAME_SIZE, "%s", particle_get_name(m));
+        header->colors[m] = particle_get_color(m);
+    }
+    for (int b = 0; b < 2; b++) {
+        header->buffers[b].plane_offset = (uint32_t)(sizeof(share_header_t) + (size_t)b * grid->width * grid->height);
+        // fresh planes are all zero
+        for (int y = 0; y < grid->height; y++) {
+            share.row_counts[(b * grid->height + y) * PARTICLE_MAX + PARTICLE_NONE] = (uint32_t)grid->width;
+        }
+    }
+    // readers check the magic last, once everything above is in place
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHARE_MAGIC, sizeof(header->magic));
+
+    share.header = header;
+    share.size = size;
+    strcpy(share.name, name);
+    return true;
+}
+
+void share_stop(void)
+{
+    free(share.scratch);
+    free(share.row_counts);
+    share.scratch = NULL;
+    share.row_counts = NULL;
+    if (!share.header)
+        return;
+    munmap(share.header, share.size);
+    shm_unlink(share.name);
+    share.header = NULL;
+}
+
+const share_header_t* share_attach(const char* name)
+{
+    const share_header_t* header = map_segment(name, sizeof(share_header_t), false);
+    if (!header)
+        return NULL;
+    const bool ours = memcmp(header->magic, SHARE_MAGIC, sizeof(header->magic)) == 0 && header->material_count == PARTICLE_MAX;
+    const size_t size = ours ? header->size : 0;
+    munmap((void*)header, sizeof(share_header_t));
+    return ours ? map_segment(name, size, false) : NULL;
+}
+
+void share_detach(const share_header_t* header)
+{
+    if (header)
+        munmap((void*)header, header->size);
+}
+
+#endif
+
+bool share_active(void)
+{
+    return share.header != NULL;
+}
+
+// :PUBLISH
+
+// narrows `count` material ids to bytes
+static void pack_cells(const int* cells, int count, uint8_t* plane)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(cells + i)), _mm_loadu_si128((const __m128i*)(cells + i + 4)));
+        const __m128i b = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(cells + i + 8)), _mm_loadu_si128((const __m128i*)(cells + i + 12)));
+        _mm_storeu_si128((__m128i*)(plane + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; i < count; i++) {
+        plane[i] = (uint8_t)cells[i];
+    }
+}
+
+// adds the materials of `count` packed cells to `counts`; four tables take
+// turns so runs of one material don't wait on the same counter
+static void count_cells(const uint8_t* plane, int count, uint32_t* counts)
+{
+    uint32_t partial[4][PARTICLE_MAX] = { { 0 } };
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        partial[0][plane[i]]++;
+        partial[1][plane[i + 1]]++;
+        partial[2][plane[i + 2]]++;
+        partial[3][plane[i + 3]]++;
+    }
+    for (; i < count; i++) {
+        partial[0][plane[i]]++;
+    }
+    for (int m = 0; m < PARTICLE_MAX; m++) {
+        counts[m] += partial[0][m] + partial[1][m] + partial[2][m] + partial[3][m];
+    }
+}
+
+void share_publish(const grid_t* grid, uint64_t tick, float tick_ms)
+{
+    share_header_t* header = share.header;
+    if (!header || (int)header->width != grid->width || (int)header->height != grid->height)
+        return;
+    const uint64_t generation = atomic_load_explicit(&header->generation, memory_order_relaxed) + 1;
+    share_buffer_t* buffer = &header->buffers[generation & 1];
+
+    const uint64_t sequence = atomic_load_explicit(&buffer->sequence, memory_order_relaxed);
+    atomic_store_explicit(&buffer->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    // the buffer is two ticks old, only rows that changed since are copied and recounted
+    uint8_t* plane = (uint8_t*)header + buffer->plane_offset;
+    memset(buffer->counts, 0, sizeof(buffer->counts));
+    for (int y = 0; y < grid->height; y++) {
+        uint8_t* row = plane + y * grid->width;
+        uint32_t* row_counts = share.row_counts + ((generation & 1) * grid->height + y) * PARTICLE_MAX;
+        for (int x = 0; x < grid->width;) {
+            const int span = grid_span(grid, x);
+            pack_cells(grid->data + grid_index(grid, x, y), span, share.scratch + x);
+            x += span;
+        }
+        if (memcmp(row, share.scratch, grid->width) != 0) {
+            memcpy(row, share.scratch, grid->width);
+            memset(row_counts, 0, sizeof(uint32_t) * PARTICLE_MAX);
+            count_cells(row, grid->width, row_counts);
+        }
+        for (int m = 0; m < PARTICLE_MAX; m++) {
+            buffer->counts[m] += row_counts[m];
+        }
+    }
+    buffer->tick = tick;
+    buffer->tick_ms = tick_ms;
+
+    atomic_store_explicit(&buffer->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&header->generation, generation, memory_order_release);
+}
+
+// :READ
+
+const share_buffer_t* share_read_begin(const share_header_t* header, uint64_t* sequence)
+{
+    for (int tries = 0; tries < SHARE_READ_TRIES; tries++) {
+        const uint64_t generation = atomic_load_explicit(&header->generation, memory_order_acquire);
+        if (!generation)
+            return NULL;
+        const share_buffer_t* buffer = &header->buffers[generation & 1];
+        *sequence = atomic_load_explicit(&buffer->sequence, memory_order_acquire);
+        if (!(*sequence & 1))
+            return buffer;
+    }
+    return NULL;
+}
+
+bool share_read_end(const share_buffer_t* buffer, uint64_t sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&buffer->sequence, memory_order_relaxed) == sequence;
+}
+
+const uint8_t* share_plane(const share_header_t* header, const share_buffer_t* buffer)
+{
+    return (const uint8_t*)header + buffer->plane_offset;
+}
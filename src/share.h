@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :SHARE
+// Publishes the material plane and a few stats into a POSIX shared memory
+// segment for analysis tools running as separate processes. The segment is a
+// share_header_t followed by two planes of width * height bytes, one material
+// id per cell in row major order. Each tick the simulation fills the buffer
+// the readers are not pointed at, then points them at it, so a reader only
+// has to retry when the writer laps it twice during one read.
+//
+// Every buffer carries a sequence number, odd while the writer is inside it.
+// A reader takes the newest buffer with share_read_begin(), reads the plane
+// and stats in place, and keeps what it read only if share_read_end() says
+// the sequence did not move in between. Nothing is serialized or copied for
+// the reader, and the simulation never waits on one.
+//
+// Not available on Windows, share_start() fails there.
+
+#define SHARE_MAGIC "SANDSHM1"
+#define SHARE_NAME_SIZE 32
+#define SHARE_READ_TRIES 4096 // share_read_begin() gives up after this many odd sequences
+
+typedef struct {
+    _Atomic uint64_t sequence; // odd while being written
+    uint64_t tick;
+    float tick_ms;
+    uint32_t plane_offset; // from the start of the segment
+    uint32_t counts[PARTICLE_MAX]; // cells of each material
+} share_buffer_t;
+
+typedef struct {
+    char magic[8]; // SHARE_MAGIC, no terminator
+    uint32_t size; // of the whole segment
+    uint32_t width;
+    uint32_t height;
+    uint32_t material_count; // PARTICLE_MAX
+    char names[PARTICLE_MAX][SHARE_NAME_SIZE];
+    uint32_t colors[PARTICLE_MAX]; // as particle_get_color
+    _Atomic uint64_t generation; // ticks published, the newest is in buffers[generation & 1]
+    share_buffer_t buffers[2];
+} share_header_t;
+
+// simulation thread; `name` is a shm_open name such as "/sandsim". A segment
+// left under that name is replaced, readers still attached to it keep the
+// old one. The segment is removed again by share_stop().
+bool share_start(const char* name, const grid_t* grid);
+void share_publish(const grid_t* grid, uint64_t tick, float tick_ms);
+void share_stop(void);
+bool share_active(void);
+
+// readers, in their own process
+const share_header_t* share_attach(const char* name); // NULL when missing or not a segment of ours
+void share_detach(const share_header_t* header);
+// the newest published buffer, NULL before the first publish or when the writer
+// stayed inside it for SHARE_READ_TRIES tries (it stopped mid-publish), try again later
+const share_buffer_t* share_read_begin(const share_header_t* header, uint64_t* sequence);
+// whether what was read since share_read_begin() is consistent
+bool share_read_end(const share_buffer_t* buffer, uint64_t sequence);
+const uint8_t* share_plane(const share_header_t* header, const share_buffer_t* buffer);
@@ -0,0 +1,113 @@
+#include "sim.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fire.h"
+#include "game.h"
+#include "gas.h"
+#include "heat.h"
+#include "liquid.h"
+#include "metrics.h"
+#include "moisture.h"
+#include "occupancy.h"
+#include "react.h"
+#include "rigid.h"
+#include "share.h"
+#include "input.h"
+#include "record.h"
+#include "snapshot.h"
+#include "thread.h"
+
+static struct {
+    thread_t thread;
+    atomic_bool running;
+    uint64_t tick;
+} sim;
+
+void sim_step(void)
+{
+    double start = time_now_ms();
+    // input lands between ticks, never in the middle of one
+    input_apply();
+    fixed_update();
+    rigid_step(&game_state.grid);
+    liquid_step(&game_state.grid);
+    fire_step(&game_state.grid);
+    gas_step(&game_state.grid);
+    react_step(&game_state.grid);
+    moisture_step(&game_state.grid);
+    heat_step(&game_state.grid);
+    record_frame(&game_state.grid);
+    sim.tick++;
+    const float tick_ms = (float)(time_now_ms() - start);
+    snapshot_publish(&game_state.grid, sim.tick, tick_ms);
+    share_publish(&game_state.grid, sim.tick, tick_ms);
+    metrics_tick(&game_state.grid, tick_ms);
+}
+
+static bool started(bool ok, const char* what)
+{
+    if (!ok)
+        fprintf(stderr, "Failed to allocate the %s field\n", what);
+    return ok;
+}
+
+bool sim_init(const grid_t* grid)
+{
+    const bool ok = started(heat_init(grid), "heat")
+        && started(liquid_init(grid), "liquid")
+        && started(rigid_init(grid), "rigid body")
+        && started(gas_init(grid), "gas")
+        && started(moisture_init(grid), "moisture")
+        && started(occupancy_init(grid), "occupancy");
+    if (!ok)
+        sim_shutdown();
+    return ok;
+}
+
+void sim_shutdown(void)
+{
+    heat_shutdown();
+    liquid_shutdown();
+    rigid_shutdown();
+    gas_shutdown();
+    moisture_shutdown();
+    occupancy_shutdown();
+}
+
+static void sim_main(void* user)
+{
+    (void)user;
+    double next = time_now_ms();
+    while (atomic_load_explicit(&sim.running, memory_order_relaxed)) {
+        sim_step();
+
+        next += TICK_INTERVAL_MS;
+        double now = time_now_ms();
+        // after a long stall, resume from now instead of running a burst of catch up ticks
+        if (now - next > TICK_INTERVAL_MS * 5)
+            next = now;
+        thread_sleep_ms(next - now);
+    }
+}
+
+bool sim_start(void)
+{
+    atomic_store(&sim.running, true);
+    if (!thread_create(&sim.thread, sim_main, NULL)) {
+        fprintf(stderr, "Failed to start simulation thread\n");
+        atomic_store(&sim.running, false);
+        return false;
+    }
+    return true;
+}
+
+void sim_stop(void)
+{
+    if (!atomic_load(&sim.running))
+        return;
+    atomic_store(&sim.running, false);
+    thread_join(sim.thread);
+}
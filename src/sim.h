@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// :SIM
+// Runs the simulation on its own thread at a fixed rate. Each tick drains the
+// input queue, runs fixed_update and the field passes, feeds the recorder and
+// publishes a snapshot for the renderer, and the grid for other processes when
+// sharing. Only the simulation thread touches game_state.grid and
+// game_state.brush while it is running.
+
+#define TICK_INTERVAL_MS 20.0
+
+// the fields every pass keeps next to the grid, reports which one failed;
+// sim_shutdown() frees them and is safe after a partial sim_init()
+bool sim_init(const grid_t* grid);
+void sim_shutdown(void);
+
+bool sim_start(void);
+void sim_stop(void);
+
+// one tick on the calling thread, for callers without a simulation thread;
+// the snapshot is skipped when snapshot_init() was not called
+void sim_step(void);
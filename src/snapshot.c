@@ -0,0 +1,118 @@
+#include "snapshot.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// set in `middle` when it holds a snapshot the reader has not seen yet
+#define SNAPSHOT_FRESH 4u
+
+static struct {
+    snapshot_t buffers[3];
+    unsigned back; // owned by the writer
+    unsigned front; // owned by the reader
+    atomic_uint middle; // index | SNAPSHOT_FRESH
+
+    // writer side copy of the last published plane, used to find changed rows
+    int* shadow;
+    uint64_t* row_tick;
+    int* scratch; // one row, for grids that are not row major
+} snapshots;
+
+static void free_snapshots(void)
+{
+    for (int i = 0; i < 3; i++) {
+        free(snapshots.buffers[i].cells);
+        free(snapshots.buffers[i].row_tick);
+        snapshots.buffers[i].cells = NULL;
+        snapshots.buffers[i].row_tick = NULL;
+    }
+    free(snapshots.shadow);
+    free(snapshots.row_tick);
+    free(snapshots.scratch);
+    snapshots.shadow = NULL;
+    snapshots.row_tick = NULL;
+    snapshots.scratch = NULL;
+}
+
+bool snapshot_init(const grid_t* grid)
+{
+    // snapshots are row major whatever the grid layout
+    const size_t plane_size = sizeof(grid->data[0]) * grid->width * grid->height;
+    snapshots.shadow = malloc(plane_size);
+    snapshots.row_tick = calloc(grid->height, sizeof(uint64_t));
+    snapshots.scratch = malloc(sizeof(grid->data[0]) * grid->width);
+    bool ok = snapshots.shadow && snapshots.row_tick && snapshots.scratch;
+    for (int y = 0; ok && y < grid->height; y++) {
+        memcpy(snapshots.shadow + y * grid->width, grid_row(grid, y, snapshots.scratch), sizeof(grid->data[0]) * grid->width);
+    }
+    for (int i = 0; i < 3; i++) {
+        snapshot_t* snapshot = &snapshots.buffers[i];
+        *snapshot = (snapshot_t) {
+            .cells = malloc(plane_size),
+            .row_tick = calloc(grid->height, sizeof(uint64_t)),
+            .width = grid->width,
+            .height = grid->height,
+            .tile_size = grid->tile_size,
+            .brush = { game_state.brush.radius, game_state.brush.element, game_state.brush.tool },
+            .engine = game_state.engine,
+        };
+        ok = ok && snapshot->cells && snapshot->row_tick;
+        if (ok)
+            memcpy(snapshot->cells, snapshots.shadow, plane_size);
+    }
+    if (!ok) {
+        free_snapshots();
+        return false;
+    }
+
+    snapshots.front = 0;
+    atomic_store(&snapshots.middle, 1);
+    snapshots.back = 2;
+    return true;
+}
+
+void snapshot_shutdown(void)
+{
+    free_snapshots();
+}
+
+void snapshot_publish(const grid_t* grid, uint64_t tick, float tick_ms)
+{
+    if (!snapshots.shadow)
+        return; // no renderer, headless runs step without snapshots
+    const int width = grid->width;
+    const size_t row_size = sizeof(grid->data[0]) * width;
+    snapshot_t* back = &snapshots.buffers[snapshots.back];
+
+    for (int y = 0; y < grid->height; y++) {
+        const int* src = grid_row(grid, y, snapshots.scratch);
+        int* shadow = snapshots.shadow + y * width;
+        if (memcmp(src, shadow, row_size) != 0) {
+            memcpy(shadow, src, row_size);
+            snapshots.row_tick[y] = tick;
+        }
+        // the back buffer is a few ticks old, bring over rows changed since
+        if (snapshots.row_tick[y] > back->tick)
+            memcpy(back->cells + y * width, shadow, row_size);
+    }
+    memcpy(back->row_tick, snapshots.row_tick, sizeof(uint64_t) * grid->height);
+    back->tick = tick;
+    back->tick_ms = tick_ms;
+    back->brush.radius = game_state.brush.radius;
+    back->brush.element = game_state.brush.element;
+    back->brush.tool = game_state.brush.tool;
+    back->engine = game_state.engine;
+
+    unsigned previous = atomic_exchange_explicit(&snapshots.middle, snapshots.back | SNAPSHOT_FRESH, memory_order_acq_rel);
+    snapshots.back = previous & ~SNAPSHOT_FRESH;
+}
+
+const snapshot_t* snapshot_acquire(void)
+{
+    if (atomic_load_explicit(&snapshots.middle, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        unsigned previous = atomic_exchange_explicit(&snapshots.middle, snapshots.front, memory_order_acq_rel);
+        snapshots.front = previous & ~SNAPSHOT_FRESH;
+    }
+    return &snapshots.buffers[snapshots.front];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// :SNAPSHOT
+// Triple buffer of render-ready copies of the grid. The simulation
+// publishes after every tick, the renderer acquires the newest one. Neither
+// side blocks: the writer always has a back buffer to fill and the reader
+// keeps its front buffer until it asks for a newer one.
+//
+// row_tick[y] is the tick at which row y last changed. A reader that last
+// drew tick T only needs to redraw rows with row_tick[y] > T, even when it
+// skipped some snapshots in between.
+
+typedef struct {
+    int* cells;
+    uint64_t* row_tick;
+    int width;
+    int height;
+    int tile_size;
+    uint64_t tick;
+    float tick_ms; // time spent simulating this tick
+    struct {
+        int radius;
+        particle_t element;
+        tool_t tool;
+    } brush;
+    engine_t engine;
+} snapshot_t;
+
+bool snapshot_init(const grid_t* grid);
+void snapshot_shutdown(void);
+
+// simulation thread, does nothing before snapshot_init()
+void snapshot_publish(const grid_t* grid, uint64_t tick, float tick_ms);
+
+// render thread, the returned snapshot stays valid until the next acquire
+const snapshot_t* snapshot_acquire(void);
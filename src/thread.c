@@ -0,0 +1,272 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // nanosleep, clock_gettime under -std=c11
+#endif
+
+#include "thread.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// :THREAD
+
+typedef struct {
+    thread_func_t func;
+    void* user;
+} thread_start_t;
+
+#if defined(_WIN32)
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.func(start.user);
+    return 0;
+}
+
+bool thread_create(thread_t* thread, thread_func_t func, void* user)
+{
+    thread_start_t* start = malloc(sizeof(*start));
+    if (!start)
+        return false;
+    *start = (thread_start_t) { func, user };
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void thread_join(thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int thread_hardware_concurrency(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+void thread_sleep_ms(double ms)
+{
+    if (ms > 0.0)
+        Sleep((DWORD)ms);
+}
+
+double time_now_ms(void)
+{
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
+void mutex_init(mutex_t* mutex) { InitializeCriticalSection(mutex); }
+void mutex_destroy(mutex_t* mutex) { DeleteCriticalSection(mutex); }
+void mutex_lock(mutex_t* mutex) { EnterCriticalSection(mutex); }
+void mutex_unlock(mutex_t* mutex) { LeaveCriticalSection(mutex); }
+
+void cond_init(cond_t* cond) { InitializeConditionVariable(cond); }
+void cond_destroy(cond_t* cond) { (void)cond; }
+void cond_wait(cond_t* cond, mutex_t* mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void cond_signal(cond_t* cond) { WakeConditionVariable(cond); }
+void cond_broadcast(cond_t* cond) { WakeAllConditionVariable(cond); }
+
+#else
+
+static void* thread_entry(void* param)
+{
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.func(start.user);
+    return NULL;
+}
+
+bool thread_create(thread_t* thread, thread_func_t func, void* user)
+{
+    thread_start_t* start = malloc(sizeof(*start));
+    if (!start)
+        return false;
+    *start = (thread_start_t) { func, user };
+    if (pthread_create(thread, NULL, thread_entry, start) != 0) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void thread_join(thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+int thread_hardware_concurrency(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void thread_sleep_ms(double ms)
+{
+    if (ms <= 0.0)
+        return;
+    struct timespec ts = { (time_t)(ms / 1000.0), (long)((ms - (time_t)(ms / 1000.0) * 1000.0) * 1000000.0) };
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+double time_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void mutex_init(mutex_t* mutex) { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(mutex_t* mutex) { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t* mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t* mutex) { pthread_mutex_unlock(mutex); }
+
+void cond_init(cond_t* cond) { pthread_cond_init(cond, NULL); }
+void cond_destroy(cond_t* cond) { pthread_cond_destroy(cond); }
+void cond_wait(cond_t* cond, mutex_t* mutex) { pthread_cond_wait(cond, mutex); }
+void cond_signal(cond_t* cond) { pthread_cond_signal(cond); }
+void cond_broadcast(cond_t* cond) { pthread_cond_broadcast(cond); }
+
+#endif
+
+// :PARALLEL
+
+static struct {
+    bool running;
+    int worker_count; // including the calling thread
+    thread_t threads[MAX_WORKER_COUNT];
+    mutex_t mutex;
+    cond_t start;
+    cond_t done;
+    unsigned generation;
+    int pending;
+    range_func_t func;
+    void* user;
+    int count;
+    atomic_flag busy;
+} pool = { .busy = ATOMIC_FLAG_INIT };
+
+static void range_for_worker(int worker, int* begin, int* end)
+{
+    *begin = (int)((long long)pool.count * worker / pool.worker_count);
+    *end = (int)((long long)pool.count * (worker + 1) / pool.worker_count);
+}
+
+static void worker_main(void* user)
+{
+    int worker = (int)(intptr_t)user;
+    unsigned seen = 0;
+    for (;;) {
+        mutex_lock(&pool.mutex);
+        while (pool.running && pool.generation == seen) {
+            cond_wait(&pool.start, &pool.mutex);
+        }
+        if (!pool.running) {
+            mutex_unlock(&pool.mutex);
+            return;
+        }
+        seen = pool.generation;
+        mutex_unlock(&pool.mutex);
+
+        int begin, end;
+        range_for_worker(worker, &begin, &end);
+        if (begin < end)
+            pool.func(begin, end, pool.user);
+
+        mutex_lock(&pool.mutex);
+        if (--pool.pending == 0)
+            cond_signal(&pool.done);
+        mutex_unlock(&pool.mutex);
+    }
+}
+
+void parallel_init(int thread_count)
+{
+    assert(!pool.running && "parallel_init called twice");
+    if (thread_count <= 0)
+        thread_count = thread_hardware_concurrency();
+    if (thread_count > MAX_WORKER_COUNT)
+        thread_count = MAX_WORKER_COUNT;
+
+    mutex_init(&pool.mutex);
+    cond_init(&pool.start);
+    cond_init(&pool.done);
+    pool.running = true;
+    pool.worker_count = 1;
+    for (int i = 1; i < thread_count; i++) {
+        if (!thread_create(&pool.threads[i], worker_main, (void*)(intptr_t)i))
+            break;
+        pool.worker_count++;
+    }
+}
+
+void parallel_shutdown(void)
+{
+    if (!pool.running)
+        return;
+    mutex_lock(&pool.mutex);
+    pool.running = false;
+    cond_broadcast(&pool.start);
+    mutex_unlock(&pool.mutex);
+    for (int i = 1; i < pool.worker_count; i++) {
+        thread_join(pool.threads[i]);
+    }
+    cond_destroy(&pool.done);
+    cond_destroy(&pool.start);
+    mutex_destroy(&pool.mutex);
+    pool.worker_count = 0;
+}
+
+int parallel_worker_count(void)
+{
+    return pool.running ? pool.worker_count : 1;
+}
+
+void parallel_for(int count, range_func_t func, void* user)
+{
+    if (!pool.running || pool.worker_count == 1 || count < pool.worker_count
+        || atomic_flag_test_and_set_explicit(&pool.busy, memory_order_acquire)) {
+        if (count > 0)
+            func(0, count, user);
+        return;
+    }
+
+    mutex_lock(&pool.mutex);
+    pool.func = func;
+    pool.user = user;
+    pool.count = count;
+    pool.pending = pool.worker_count - 1;
+    pool.generation++;
+    cond_broadcast(&pool.start);
+    mutex_unlock(&pool.mutex);
+
+    int begin, end;
+    range_for_worker(0, &begin, &end);
+    func(begin, end, user);
+
+    mutex_lock(&pool.mutex);
+    while (pool.pending > 0) {
+        cond_wait(&pool.done, &pool.mutex);
+    }
+    mutex_unlock(&pool.mutex);
+    atomic_flag_clear_explicit(&pool.busy, memory_order_release);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+// :THREAD
+
+typedef void (*thread_func_t)(void* user);
+
+bool thread_create(thread_t* thread, thread_func_t func, void* user);
+void thread_join(thread_t thread);
+int thread_hardware_concurrency(void);
+void thread_sleep_ms(double ms);
+double time_now_ms(void); // monotonic
+
+void mutex_init(mutex_t* mutex);
+void mutex_destroy(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+void cond_init(cond_t* cond);
+void cond_destroy(cond_t* cond);
+void cond_wait(cond_t* cond, mutex_t* mutex);
+void cond_signal(cond_t* cond);
+void cond_broadcast(cond_t* cond);
+
+// :PARALLEL
+
+// Splits [0, count) into one contiguous range per worker and blocks until all
+// ranges are done. Runs inline when parallel_init was not called, or when
+// another thread is already using the pool.
+typedef void (*range_func_t)(int begin, int end, void* user);
+
+#define MAX_WORKER_COUNT 64
+
+void parallel_init(int thread_count); // <= 0 -> hardware concurrency
+void parallel_shutdown(void);
+int parallel_worker_count(void);
+void parallel_for(int count, range_func_t func, void* user);